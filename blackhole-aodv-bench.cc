@@ -0,0 +1,194 @@
+// Standalone microbenchmark for the BlackholeAodv drop-decision kernels.
+// No ns-3 dependency; the kernels are copied from blackhole-aodv.cc and
+// must be kept in sync with it.
+//
+//   g++ -O2 -march=native -std=c++17 blackhole-aodv-bench.cc -o blackhole-aodv-bench
+//   ./blackhole-aodv-bench [decisions]
+//
+// Compares one Philox4x32 call per packet against refilling 4096-bit
+// decision blocks with Philox4x32Batch64, and checks both give the same
+// decision stream. Then times the Gilbert-Elliott model against the
+// per-packet Bernoulli draw it replaces.
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+// Philox4x32-10 (Salmon et al., SC'11); returns 64 of the 128 output bits
+static inline uint64_t Philox4x32(uint64_t counter, uint64_t run, uint32_t key0, uint32_t key1) {
+    uint32_t c0 = static_cast<uint32_t>(counter);
+    uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+    uint32_t c2 = static_cast<uint32_t>(run);
+    uint32_t c3 = static_cast<uint32_t>(run >> 32);
+    for (int round = 0; round < 10; ++round) {
+        uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+        uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+        uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ key0;
+        uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ key1;
+        c1 = static_cast<uint32_t>(p1);
+        c3 = static_cast<uint32_t>(p0);
+        c0 = n0;
+        c2 = n2;
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    return (static_cast<uint64_t>(c0) << 32) | c1;
+}
+
+// Philox4x32-10 over 64 consecutive counters at once
+static void Philox4x32Batch64(uint64_t firstCounter, uint64_t run, uint32_t key0, uint32_t key1,
+                              uint64_t out[64]) {
+    uint32_t c0[64], c1[64], c2[64], c3[64];
+    for (uint32_t lane = 0; lane < 64; ++lane) {
+        uint64_t counter = firstCounter + lane;
+        c0[lane] = static_cast<uint32_t>(counter);
+        c1[lane] = static_cast<uint32_t>(counter >> 32);
+        c2[lane] = static_cast<uint32_t>(run);
+        c3[lane] = static_cast<uint32_t>(run >> 32);
+    }
+    for (int round = 0; round < 10; ++round) {
+        for (uint32_t lane = 0; lane < 64; ++lane) {
+            uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0[lane];
+            uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2[lane];
+            c0[lane] = static_cast<uint32_t>(p1 >> 32) ^ c1[lane] ^ key0;
+            c2[lane] = static_cast<uint32_t>(p0 >> 32) ^ c3[lane] ^ key1;
+            c1[lane] = static_cast<uint32_t>(p1);
+            c3[lane] = static_cast<uint32_t>(p0);
+        }
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    for (uint32_t lane = 0; lane < 64; ++lane) {
+        out[lane] = (static_cast<uint64_t>(c0[lane]) << 32) | c1[lane];
+    }
+}
+
+static inline uint64_t ProbabilityToThreshold(double probability) {
+    return static_cast<uint64_t>(std::ldexp(probability, 63));
+}
+
+static inline uint64_t ProbabilityToThreshold32(double probability) {
+    return static_cast<uint64_t>(std::ldexp(probability, 32));
+}
+
+// Same step as BlackholeAodv::NextBurstDecision
+struct BurstModel {
+    bool bad;
+    uint64_t goodDrop;
+    uint64_t badDrop;
+    uint64_t goodToBad;
+    uint64_t badToGood;
+
+    bool Next(uint64_t draw) {
+        uint64_t dropDraw = draw & 0xFFFFFFFFu;
+        uint64_t transitionDraw = draw >> 32;
+        bool drop = dropDraw < (bad ? badDrop : goodDrop);
+        bad = bad ? (transitionDraw >= badToGood) : (transitionDraw < goodToBad);
+        return drop;
+    }
+};
+
+static const uint32_t DECISION_BLOCK_BITS = 4096;
+static const uint32_t DECISION_BLOCK_WORDS = DECISION_BLOCK_BITS / 64;
+
+// Same loop as BlackholeAodv::RefillDecisionBlock
+static void RefillDecisionBlock(uint64_t base, uint64_t threshold, uint64_t bits[DECISION_BLOCK_WORDS]) {
+    uint64_t draws[64];
+    for (uint32_t word = 0; word < DECISION_BLOCK_WORDS; ++word) {
+        Philox4x32Batch64(base + word * 64, 7, 1, 3, draws);
+        uint64_t value = 0;
+        for (uint32_t lane = 0; lane < 64; ++lane) {
+            value |= static_cast<uint64_t>((draws[lane] >> 1) < threshold) << lane;
+        }
+        bits[word] = value;
+    }
+}
+
+int main(int argc, char *argv[]) {
+    uint64_t decisions = (argc > 1) ? std::strtoull(argv[1], nullptr, 10) : (1u << 22);
+    decisions -= decisions % DECISION_BLOCK_BITS;
+    if (decisions == 0) {
+        decisions = DECISION_BLOCK_BITS;
+    }
+
+    // Bit i of a block must be exactly the per-packet decision for base + i
+    int status = 0;
+    alignas(64) uint64_t bits[DECISION_BLOCK_WORDS];
+    uint64_t verifyThreshold = ProbabilityToThreshold(0.5);
+    for (uint64_t base = 0; base < 16 * DECISION_BLOCK_BITS; base += DECISION_BLOCK_BITS) {
+        RefillDecisionBlock(base, verifyThreshold, bits);
+        for (uint32_t i = 0; i < DECISION_BLOCK_BITS; ++i) {
+            bool expected = (Philox4x32(base + i, 7, 1, 3) >> 1) < verifyThreshold;
+            if (((bits[i >> 6] >> (i & 63)) & 1) != expected) {
+                std::printf("decision mismatch at counter %llu\n", static_cast<unsigned long long>(base + i));
+                status = 1;
+            }
+        }
+    }
+
+    const double probabilities[] = {0.1, 0.5, 0.9, 1.0};
+    for (double probability : probabilities) {
+        uint64_t threshold = ProbabilityToThreshold(probability);
+
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t perPacketDrops = 0;
+        for (uint64_t i = 0; i < decisions; ++i) {
+            perPacketDrops += (Philox4x32(i, 7, 1, 3) >> 1) < threshold;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t blockDrops = 0;
+        for (uint64_t base = 0; base < decisions; base += DECISION_BLOCK_BITS) {
+            RefillDecisionBlock(base, threshold, bits);
+            for (uint32_t i = 0; i < DECISION_BLOCK_BITS; ++i) {
+                blockDrops += (bits[i >> 6] >> (i & 63)) & 1;
+            }
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        double perPacket = std::chrono::duration<double, std::nano>(t1 - t0).count() / decisions;
+        double block = std::chrono::duration<double, std::nano>(t2 - t1).count() / decisions;
+        std::printf("p=%.1f per-packet %.2f ns, block %.2f ns, drop rate %.4f\n", probability, perPacket, block,
+                    static_cast<double>(blockDrops) / decisions);
+        if (perPacketDrops != blockDrops) {
+            std::printf("drop count mismatch: per-packet %llu, block %llu\n",
+                        static_cast<unsigned long long>(perPacketDrops),
+                        static_cast<unsigned long long>(blockDrops));
+            status = 1;
+        }
+    }
+
+    // Gilbert-Elliott against Bernoulli, both one draw per packet; the
+    // stationary drop rate is printed next to the configured mean
+    struct BurstCase {
+        double goodDrop, badDrop, goodToBad, badToGood;
+    };
+    const BurstCase burstCases[] = {{0.0, 1.0, 0.01, 0.1}, {0.05, 0.9, 0.05, 0.2}, {0.1, 0.5, 0.5, 0.5}};
+    for (const BurstCase &c : burstCases) {
+        double badShare = c.goodToBad / (c.goodToBad + c.badToGood);
+        double mean = (1 - badShare) * c.goodDrop + badShare * c.badDrop;
+        uint64_t threshold = ProbabilityToThreshold(mean);
+        BurstModel model = {false, ProbabilityToThreshold32(c.goodDrop), ProbabilityToThreshold32(c.badDrop),
+                            ProbabilityToThreshold32(c.goodToBad), ProbabilityToThreshold32(c.badToGood)};
+
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t bernoulliDrops = 0;
+        for (uint64_t i = 0; i < decisions; ++i) {
+            bernoulliDrops += (Philox4x32(i, 7, 1, 3) >> 1) < threshold;
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        uint64_t burstDrops = 0;
+        for (uint64_t i = 0; i < decisions; ++i) {
+            burstDrops += model.Next(Philox4x32(i, 7, 1, 3));
+        }
+        auto t2 = std::chrono::steady_clock::now();
+
+        double bernoulli = std::chrono::duration<double, std::nano>(t1 - t0).count() / decisions;
+        double burst = std::chrono::duration<double, std::nano>(t2 - t1).count() / decisions;
+        std::printf("mean p=%.4f bernoulli %.2f ns (rate %.4f), gilbert-elliott %.2f ns (rate %.4f)\n", mean,
+                    bernoulli, static_cast<double>(bernoulliDrops) / decisions, burst,
+                    static_cast<double>(burstDrops) / decisions);
+    }
+    return status;
+}
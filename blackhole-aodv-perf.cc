@@ -0,0 +1,357 @@
+// Throughput harness for BlackholeAodv. Build it as an ns-3 program next to
+// blackhole.cc and run, e.g.:
+//   ./ns3 run "blackhole-aodv-perf --mode=decorator"
+//
+// decorator: runs the grid of blackhole.cc twice with one UDP flow, once
+// with plain AODV and once with every node wrapped by BlackholeAodv at
+// DropProbability 0, and compares the simulator events executed per
+// wall-clock second. The fastest of --repeats runs of each is kept.
+//
+// filter: builds a line 0 - 1 - 2 over two point-to-point simple channels,
+// lets AODV find the route from 0 to 2 through node 1, then stops the
+// simulation and calls RouteInput of node 1 directly with one transit
+// packet, --packets times, for plain AODV and for each specialization of
+// the forward filter. Prints ns per packet and the cost over plain AODV.
+//
+// classify: same line, but the packet is addressed to node 1 itself.
+// BlackholeAodv then runs Classify and delivers it, so its time per packet
+// bounds the cost of classification (target: under 20 ns); plain AODV's
+// local delivery is printed for reference.
+//
+// cbr: one flow of --packetRate packets per second for --simTime seconds
+// between two directly linked nodes, either pre-scheduled as one event per
+// packet (--preschedule=1, as blackhole.cc used to do) or sent by CbrSource.
+// Prints the sends queued at start, setup and run wall time, and the
+// peak RSS. Run each variant in its own process, as the peak never drops.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/aodv-module.h"
+#include "ns3/applications-module.h"
+#include "/home/uwe/ns3/ns-allinone-3.43/ns-3.43/src/aodv/model/blackhole-aodv.h"
+#include "blackhole-traffic.h"
+#include <sys/resource.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+struct RunResult {
+    uint64_t events;
+    double seconds; // Wall-clock time of Simulator::Run()
+    uint64_t received;
+};
+
+// Grid, radio and traffic of blackhole.cc's default scenario
+static RunResult RunGrid(bool decorated, uint32_t nodes, double packetRate, double simTime) {
+    RngSeedManager::SetSeed(1);
+    RngSeedManager::SetRun(1);
+    NodeContainer nodeContainer;
+    nodeContainer.Create(nodes);
+
+    MobilityHelper mobility;
+    mobility.SetPositionAllocator("ns3::GridPositionAllocator",
+                                  "MinX", DoubleValue(0.0),
+                                  "MinY", DoubleValue(0.0),
+                                  "DeltaX", DoubleValue(50.0),
+                                  "DeltaY", DoubleValue(50.0),
+                                  "GridWidth", UintegerValue(10),
+                                  "LayoutType", StringValue("RowFirst"));
+    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+    mobility.Install(nodeContainer);
+
+    YansWifiChannelHelper wifiChannel = YansWifiChannelHelper::Default();
+    YansWifiPhyHelper wifiPhy;
+    wifiPhy.SetChannel(wifiChannel.Create());
+    WifiHelper wifiHelper;
+    wifiHelper.SetRemoteStationManager("ns3::ConstantRateWifiManager", "DataMode", StringValue("OfdmRate6Mbps"));
+    WifiMacHelper wifiMac;
+    wifiMac.SetType("ns3::AdhocWifiMac");
+    NetDeviceContainer devices = wifiHelper.Install(wifiPhy, wifiMac, nodeContainer);
+
+    // Every node is decorated and forwards everything, so any difference
+    // is the cost of the wrapper on the forwarding path
+    AodvHelper aodvHelper;
+    BlackholeAodvHelper blackholeHelper;
+    blackholeHelper.SetBlackhole("DropProbability", DoubleValue(0.0));
+    for (uint32_t i = 0; i < nodes; ++i) {
+        blackholeHelper.AddAttacker(nodeContainer.Get(i)->GetId());
+    }
+    InternetStackHelper internet;
+    if (decorated) {
+        internet.SetRoutingHelper(blackholeHelper);
+    } else {
+        internet.SetRoutingHelper(aodvHelper);
+    }
+    internet.Install(nodeContainer);
+    Ipv4AddressHelper ipv4;
+    ipv4.SetBase("10.1.1.0", "255.255.255.0");
+    Ipv4InterfaceContainer interfaces = ipv4.Assign(devices);
+
+    UdpServerHelper server(9);
+    ApplicationContainer serverApps = server.Install(nodeContainer.Get(nodes - 1));
+    UdpClientHelper client(interfaces.GetAddress(nodes - 1), 9);
+    client.SetAttribute("MaxPackets", UintegerValue(0));
+    client.SetAttribute("Interval", TimeValue(Seconds(1.0 / packetRate)));
+    client.SetAttribute("PacketSize", UintegerValue(1024));
+    ApplicationContainer clientApps = client.Install(nodeContainer.Get(1));
+    clientApps.Start(Seconds(0));
+    clientApps.Stop(Seconds(simTime));
+
+    Simulator::Stop(Seconds(simTime));
+    auto t0 = std::chrono::steady_clock::now();
+    Simulator::Run();
+    auto t1 = std::chrono::steady_clock::now();
+
+    RunResult result;
+    result.events = Simulator::GetEventCount();
+    result.seconds = std::chrono::duration<double>(t1 - t0).count();
+    result.received = DynamicCast<UdpServer>(serverApps.Get(0))->GetReceived();
+    Simulator::Destroy();
+    BlackholeCollusionRegistry::Clear();
+    return result;
+}
+
+static void RunDecorator(uint32_t nodes, double packetRate, double simTime, uint32_t repeats) {
+    RunResult best[2];
+    for (uint32_t r = 0; r < repeats; ++r) {
+        // Alternated, so drift in machine load hits both alike
+        for (int decorated = 0; decorated < 2; ++decorated) {
+            RunResult result = RunGrid(decorated, nodes, packetRate, simTime);
+            if (r == 0 || result.seconds < best[decorated].seconds) {
+                best[decorated] = result;
+            }
+        }
+    }
+    double plain = best[0].events / best[0].seconds;
+    double decorated = best[1].events / best[1].seconds;
+    std::cout << "aodv:      " << best[0].events << " events in " << best[0].seconds << " s, " << plain
+              << " events/s, " << best[0].received << " packets received" << std::endl;
+    std::cout << "decorated: " << best[1].events << " events in " << best[1].seconds << " s, " << decorated
+              << " events/s, " << best[1].received << " packets received" << std::endl;
+    std::cout << "overhead:  " << 100.0 * (1.0 - decorated / plain) << "% events/s" << std::endl;
+}
+
+static uint64_t g_forwarded = 0;
+
+static void CountForward(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header) {
+    g_forwarded++;
+}
+
+static void IgnoreMulticast(Ptr<Ipv4MulticastRoute> route, Ptr<const Packet> packet, const Ipv4Header &header) {}
+
+static void IgnoreLocal(Ptr<const Packet> packet, const Ipv4Header &header, uint32_t interface) {}
+
+static void IgnoreError(Ptr<const Packet> packet, const Ipv4Header &header, Socket::SocketErrno error) {}
+
+static void SendWarmup(Ptr<Socket> socket, Ipv4Address destination) {
+    socket->SendTo(Create<Packet>(64), 0, InetSocketAddress(destination, 9));
+}
+
+// Line 0 - 1 - 2 with node 1 running typeName, or plain AODV if empty;
+// returns once node 1 holds a route from 0 to 2
+struct Line {
+    NodeContainer nodes;
+    Ipv4InterfaceContainer first;  // 0 - 1
+    Ipv4InterfaceContainer second; // 1 - 2
+    Ptr<Ipv4RoutingProtocol> relay;
+    Ptr<NetDevice> relayDevice;    // Node 1 towards node 0
+};
+
+static void BuildLine(Line &line, const std::string &typeName, double dropProbability) {
+    line.nodes.Create(3);
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer first = simple.Install(NodeContainer(line.nodes.Get(0), line.nodes.Get(1)));
+    NetDeviceContainer second = simple.Install(NodeContainer(line.nodes.Get(1), line.nodes.Get(2)));
+
+    AodvHelper aodvHelper;
+    BlackholeAodvHelper blackholeHelper;
+    InternetStackHelper internet;
+    if (typeName.empty()) {
+        internet.SetRoutingHelper(aodvHelper);
+    } else {
+        blackholeHelper.SetBlackholeType(typeName);
+        blackholeHelper.SetBlackhole("DropProbability", DoubleValue(dropProbability));
+        blackholeHelper.AddAttacker(line.nodes.Get(1)->GetId());
+        internet.SetRoutingHelper(blackholeHelper);
+    }
+    internet.Install(line.nodes);
+    Ipv4AddressHelper addresses;
+    addresses.SetBase("10.1.1.0", "255.255.255.0");
+    line.first = addresses.Assign(first);
+    addresses.SetBase("10.1.2.0", "255.255.255.0");
+    line.second = addresses.Assign(second);
+
+    Ptr<Socket> source = Socket::CreateSocket(line.nodes.Get(0), UdpSocketFactory::GetTypeId());
+    for (uint32_t i = 0; i < 10; ++i) {
+        Simulator::Schedule(Seconds(1.0 + 0.1 * i), &SendWarmup, source, line.second.GetAddress(1));
+    }
+    Simulator::Stop(Seconds(2.5));
+    Simulator::Run();
+
+    line.relay = line.nodes.Get(1)->GetObject<Ipv4>()->GetRoutingProtocol();
+    line.relayDevice = first.Get(1);
+}
+
+// ns per RouteInput call of node 1 for a packet from 0 to destination
+static double TimeRouteInput(const Line &line, Ipv4Address destination, uint64_t packets) {
+    Ptr<const Packet> packet = Create<Packet>(64);
+    Ipv4Header header;
+    header.SetSource(line.first.GetAddress(0));
+    header.SetDestination(destination);
+    header.SetProtocol(17);
+    header.SetTtl(64);
+    header.SetPayloadSize(packet->GetSize());
+    Ipv4RoutingProtocol::UnicastForwardCallback ucb = MakeCallback(&CountForward);
+    Ipv4RoutingProtocol::MulticastForwardCallback mcb = MakeCallback(&IgnoreMulticast);
+    Ipv4RoutingProtocol::LocalDeliverCallback lcb = MakeCallback(&IgnoreLocal);
+    Ipv4RoutingProtocol::ErrorCallback ecb = MakeCallback(&IgnoreError);
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < packets; ++i) {
+        line.relay->RouteInput(packet, header, line.relayDevice, ucb, mcb, lcb, ecb);
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(t1 - t0).count() / packets;
+}
+
+static void RunFilter(double dropProbability, uint64_t packets) {
+    const std::vector<std::string> typeNames = {"",
+                                                "ns3::BlackholeAodv",
+                                                "ns3::BlackholeAodvAlwaysDrop",
+                                                "ns3::BlackholeAodvBernoulli",
+                                                "ns3::BlackholeAodvFlowAccounting",
+                                                "ns3::BlackholeAodvGilbertElliott"};
+    double baseline = 0;
+    for (const std::string &typeName : typeNames) {
+        Line line;
+        BuildLine(line, typeName, dropProbability);
+        g_forwarded = 0;
+        double perPacket = TimeRouteInput(line, line.second.GetAddress(1), packets);
+        if (typeName.empty()) {
+            baseline = perPacket;
+        }
+        std::cout << (typeName.empty() ? "ns3::aodv::RoutingProtocol" : typeName) << ": " << perPacket
+                  << " ns/packet (+" << perPacket - baseline << " over AODV), " << g_forwarded << " of "
+                  << packets << " forwarded" << std::endl;
+        Simulator::Destroy();
+        BlackholeCollusionRegistry::Clear();
+    }
+}
+
+static void RunClassify(uint64_t packets) {
+    for (const char *typeName : {"", "ns3::BlackholeAodv"}) {
+        Line line;
+        BuildLine(line, typeName, 0.0);
+        double perPacket = TimeRouteInput(line, line.first.GetAddress(1), packets);
+        std::cout << (*typeName ? typeName : "ns3::aodv::RoutingProtocol") << ": " << perPacket
+                  << " ns/packet delivered locally" << std::endl;
+        Simulator::Destroy();
+        BlackholeCollusionRegistry::Clear();
+    }
+}
+
+static void SendStamped(Ptr<Socket> socket, uint32_t seq, uint32_t packetSize) {
+    Ptr<Packet> packet = Create<Packet>(packetSize - FlowSeqHeader::SIZE);
+    FlowSeqHeader header;
+    header.m_seq = seq;
+    header.m_sendTime = Simulator::Now().GetTimeStep();
+    packet->AddHeader(header);
+    socket->Send(packet);
+}
+
+static void RunCbr(bool preschedule, double packetRate, double simTime) {
+    auto t0 = std::chrono::steady_clock::now();
+    NodeContainer nodes;
+    nodes.Create(2);
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer devices = simple.Install(nodes);
+    InternetStackHelper internet;
+    internet.Install(nodes);
+    Ipv4AddressHelper addresses;
+    addresses.SetBase("10.1.1.0", "255.255.255.0");
+    Ipv4InterfaceContainer interfaces = addresses.Assign(devices);
+    InetSocketAddress remote(interfaces.GetAddress(1), 9);
+
+    Ptr<CbrSink> sink = CreateObject<CbrSink>();
+    nodes.Get(1)->AddApplication(sink);
+    sink->SetStartTime(Seconds(0));
+
+    Ptr<CbrSource> source;
+    uint64_t queued = 0;
+    if (preschedule) {
+        Ptr<Socket> socket = Socket::CreateSocket(nodes.Get(0), UdpSocketFactory::GetTypeId());
+        socket->Connect(remote);
+        uint64_t packets = packetRate * simTime;
+        for (uint64_t i = 0; i < packets; ++i) {
+            Simulator::Schedule(Seconds(i / packetRate), &SendStamped, socket, i, 1024);
+        }
+        queued = packets;
+    } else {
+        source = CreateObject<CbrSource>();
+        source->SetAttribute("Remote", AddressValue(remote));
+        source->SetAttribute("PacketRate", DoubleValue(packetRate));
+        nodes.Get(0)->AddApplication(source);
+        source->SetStartTime(Seconds(0));
+        source->SetStopTime(Seconds(simTime));
+        queued = 1;
+    }
+    auto t1 = std::chrono::steady_clock::now();
+
+    Simulator::Stop(Seconds(simTime));
+    Simulator::Run();
+    auto t2 = std::chrono::steady_clock::now();
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    std::cout << (preschedule ? "pre-scheduled" : "CbrSource") << ": " << queued << " sends queued at start, setup "
+              << std::chrono::duration<double>(t1 - t0).count() << " s, run "
+              << std::chrono::duration<double>(t2 - t1).count() << " s, " << Simulator::GetEventCount()
+              << " events, " << sink->GetReceived() << " packets received, peak RSS " << usage.ru_maxrss
+              << " KB" << std::endl;
+    Simulator::Destroy();
+}
+
+int main(int argc, char *argv[]) {
+    std::string mode = "decorator";
+    uint32_t nodes = 200;
+    double packetRate = 1024;
+    double simTime = 10.0;
+    uint32_t repeats = 3;
+    double dropProbability = 0.5;
+    uint64_t packets = 1000000;
+    bool preschedule = false;
+
+    CommandLine cmd(__FILE__);
+    cmd.AddValue("mode", "decorator, filter, classify or cbr", mode);
+    cmd.AddValue("nodes", "Grid nodes (decorator)", nodes);
+    cmd.AddValue("packetRate", "Packets per second of the flow (decorator, cbr)", packetRate);
+    cmd.AddValue("simTime", "Simulated seconds per run (decorator, cbr)", simTime);
+    cmd.AddValue("repeats", "Runs per configuration; the fastest is kept", repeats);
+    cmd.AddValue("dropProbability", "DropProbability of the attacker (filter)", dropProbability);
+    cmd.AddValue("packets", "RouteInput calls per configuration (filter, classify)", packets);
+    cmd.AddValue("preschedule", "Schedule every send before Run() instead of using CbrSource (cbr)", preschedule);
+    cmd.Parse(argc, argv);
+    if (repeats == 0) {
+        repeats = 1;
+    }
+
+    if (mode == "decorator") {
+        RunDecorator(nodes, packetRate, simTime, repeats);
+    } else if (mode == "filter") {
+        RunFilter(dropProbability, packets);
+    } else if (mode == "classify") {
+        RunClassify(packets);
+    } else if (mode == "cbr") {
+        RunCbr(preschedule, packetRate, simTime);
+    } else {
+        std::cerr << "Unknown mode " << mode << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,96 @@
+#include "blackhole-aodv.h"
+#include "ns3/double.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/node-container.h"
+#include "ns3/packet.h"
+#include "ns3/simple-net-device-helper.h"
+#include "ns3/simulator.h"
+#include "ns3/socket.h"
+#include "ns3/test.h"
+#include "ns3/udp-socket-factory.h"
+
+using namespace ns3;
+
+// Traffic addressed to the attacker itself is delivered locally, even with
+// DropProbability 1.0, and never shows up in its drop or forward counters.
+class BlackholeAodvLocalDeliveryTestCase : public TestCase {
+public:
+    BlackholeAodvLocalDeliveryTestCase();
+
+private:
+    void DoRun() override;
+    void Send(Ptr<Socket> socket, Ipv4Address destination);
+    void Receive(Ptr<Socket> socket);
+
+    static const uint16_t PORT = 9;
+    static const uint32_t PACKETS = 10;
+
+    uint32_t m_received;
+};
+
+BlackholeAodvLocalDeliveryTestCase::BlackholeAodvLocalDeliveryTestCase()
+    : TestCase("Packets addressed to the attacker are delivered, not dropped"),
+      m_received(0) {}
+
+void BlackholeAodvLocalDeliveryTestCase::Send(Ptr<Socket> socket, Ipv4Address destination) {
+    socket->SendTo(Create<Packet>(64), 0, InetSocketAddress(destination, PORT));
+}
+
+void BlackholeAodvLocalDeliveryTestCase::Receive(Ptr<Socket> socket) {
+    while (socket->Recv()) {
+        m_received++;
+    }
+}
+
+void BlackholeAodvLocalDeliveryTestCase::DoRun() {
+    // Node 1 is the attacker; both nodes share one broadcast channel
+    NodeContainer nodes;
+    nodes.Create(2);
+    SimpleNetDeviceHelper simple;
+    NetDeviceContainer devices = simple.Install(nodes);
+
+    BlackholeAodvHelper aodv;
+    aodv.SetBlackhole("DropProbability", DoubleValue(1.0));
+    aodv.AddAttacker(nodes.Get(1)->GetId());
+    InternetStackHelper internet;
+    internet.SetRoutingHelper(aodv);
+    internet.Install(nodes);
+    Ipv4AddressHelper addresses;
+    addresses.SetBase("10.1.1.0", "255.255.255.0");
+    Ipv4InterfaceContainer interfaces = addresses.Assign(devices);
+
+    Ptr<Socket> sink = Socket::CreateSocket(nodes.Get(1), UdpSocketFactory::GetTypeId());
+    sink->Bind(InetSocketAddress(Ipv4Address::GetAny(), PORT));
+    sink->SetRecvCallback(MakeCallback(&BlackholeAodvLocalDeliveryTestCase::Receive, this));
+    Ptr<Socket> source = Socket::CreateSocket(nodes.Get(0), UdpSocketFactory::GetTypeId());
+    for (uint32_t i = 0; i < PACKETS; ++i) {
+        Simulator::Schedule(Seconds(1.0 + 0.1 * i), &BlackholeAodvLocalDeliveryTestCase::Send, this, source,
+                            interfaces.GetAddress(1));
+    }
+
+    Simulator::Stop(Seconds(5));
+    Simulator::Run();
+
+    Ptr<BlackholeAodv> attacker = nodes.Get(1)->GetObject<BlackholeAodv>();
+    NS_TEST_ASSERT_MSG_NE(attacker, nullptr, "Node 1 should run BlackholeAodv");
+    NS_TEST_ASSERT_MSG_EQ(m_received, PACKETS, "Every packet to the attacker should be delivered to it");
+    NS_TEST_ASSERT_MSG_EQ(attacker->GetTotalDroppedPackets(), 0, "Local packets must not be counted as dropped");
+    NS_TEST_ASSERT_MSG_EQ(attacker->GetTotalForwardedPackets(), 0, "Local packets are not transit packets");
+
+    Simulator::Destroy();
+    BlackholeCollusionRegistry::Clear();
+}
+
+class BlackholeAodvTestSuite : public TestSuite {
+public:
+    BlackholeAodvTestSuite();
+};
+
+BlackholeAodvTestSuite::BlackholeAodvTestSuite()
+    : TestSuite("blackhole-aodv", Type::UNIT) {
+    AddTestCase(new BlackholeAodvLocalDeliveryTestCase, TestCase::Duration::QUICK);
+}
+
+static BlackholeAodvTestSuite g_blackholeAodvTestSuite;
@@ -2,12 +2,319 @@
 #include "ns3/log.h"
 #include "ns3/ipv4-header.h"
 #include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/string.h"
+#include "ns3/enum.h"
+#include "ns3/nstime.h"
+#include "ns3/pointer.h"
 #include "ns3/attribute.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/simulator.h"
+#include "ns3/rng-seed-manager.h"
+#include "ns3/node.h"
+#include "ns3/socket.h"
+#include "ns3/node-list.h"
+#include "ns3/output-stream-wrapper.h"
+#include "ns3/ipv4-route.h"
+#include "ns3/arp-header.h"
+#include "ns3/arp-l3-protocol.h"
+#include "ns3/wifi-net-device.h"
+#include "aodv-packet.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <sstream>
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE("BlackholeAodv");
 
+NS_OBJECT_ENSURE_REGISTERED(BlackholeAodv);
+NS_OBJECT_ENSURE_REGISTERED(BlackholeAodvAlwaysDrop);
+NS_OBJECT_ENSURE_REGISTERED(BlackholeAodvBernoulli);
+NS_OBJECT_ENSURE_REGISTERED(BlackholeAodvFlowAccounting);
+NS_OBJECT_ENSURE_REGISTERED(BlackholeAodvGilbertElliott);
+
+// Cold-path log subscriber; only connected when the log component is enabled
+static void LogPacketDecision(Ptr<const Packet> packet, const Ipv4Header &header, bool dropped) {
+    if (dropped) {
+        NS_LOG_WARN("BlackholeAodv: Dropped packet from " << header.GetSource()
+                    << " to " << header.GetDestination());
+    } else {
+        NS_LOG_INFO("BlackholeAodv: Forwarded packet from " << header.GetSource()
+                    << " to " << header.GetDestination());
+    }
+}
+
+// Philox4x32-10 (Salmon et al., SC'11); returns 64 of the 128 output bits
+static inline uint64_t Philox4x32(uint64_t counter, uint64_t run, uint32_t key0, uint32_t key1) {
+    uint32_t c0 = static_cast<uint32_t>(counter);
+    uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+    uint32_t c2 = static_cast<uint32_t>(run);
+    uint32_t c3 = static_cast<uint32_t>(run >> 32);
+    for (int round = 0; round < 10; ++round) {
+        uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0;
+        uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2;
+        uint32_t n0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ key0;
+        uint32_t n2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ key1;
+        c1 = static_cast<uint32_t>(p1);
+        c3 = static_cast<uint32_t>(p0);
+        c0 = n0;
+        c2 = n2;
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    return (static_cast<uint64_t>(c0) << 32) | c1;
+}
+
+// Philox4x32-10 over 64 consecutive counters at once. The state is kept
+// structure-of-arrays and every loop is branch-free so the compiler can
+// vectorize the 32x32->64 multiplies across lanes.
+static void Philox4x32Batch64(uint64_t firstCounter, uint64_t run, uint32_t key0, uint32_t key1,
+                              uint64_t out[64]) {
+    uint32_t c0[64], c1[64], c2[64], c3[64];
+    for (uint32_t lane = 0; lane < 64; ++lane) {
+        uint64_t counter = firstCounter + lane;
+        c0[lane] = static_cast<uint32_t>(counter);
+        c1[lane] = static_cast<uint32_t>(counter >> 32);
+        c2[lane] = static_cast<uint32_t>(run);
+        c3[lane] = static_cast<uint32_t>(run >> 32);
+    }
+    for (int round = 0; round < 10; ++round) {
+        for (uint32_t lane = 0; lane < 64; ++lane) {
+            uint64_t p0 = static_cast<uint64_t>(0xD2511F53u) * c0[lane];
+            uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u) * c2[lane];
+            c0[lane] = static_cast<uint32_t>(p1 >> 32) ^ c1[lane] ^ key0;
+            c2[lane] = static_cast<uint32_t>(p0 >> 32) ^ c3[lane] ^ key1;
+            c1[lane] = static_cast<uint32_t>(p1);
+            c3[lane] = static_cast<uint32_t>(p0);
+        }
+        key0 += 0x9E3779B9u;
+        key1 += 0xBB67AE85u;
+    }
+    for (uint32_t lane = 0; lane < 64; ++lane) {
+        out[lane] = (static_cast<uint64_t>(c0[lane]) << 32) | c1[lane];
+    }
+}
+
+// Maps a probability onto the integer threshold compared against draw >> 1;
+// 1.0 becomes 2^63, which every 63-bit draw is below.
+static inline uint64_t ProbabilityToThreshold(double probability) {
+    return static_cast<uint64_t>(std::ldexp(probability, 63));
+}
+
+// Same for comparisons against a 32-bit draw; 1.0 becomes 2^32
+static inline uint64_t ProbabilityToThreshold32(double probability) {
+    return static_cast<uint64_t>(std::ldexp(probability, 32));
+}
+
+// Kind field of a BlackholeFlowKey, non-zero (see BlackholeFlowKey). The
+// policy table holds the three POLICY_ kinds; every other table keys its
+// entries with a kind of its own.
+enum FlowKeyKind {
+    POLICY_FLOW = 1,
+    POLICY_SOURCE = 2,
+    POLICY_DESTINATION = 3,
+    COLLUDER_ADDRESS = 4,
+    RUSHED_REQUEST = 5,
+    HEARD_NEIGHBOR = 6,
+    CACHED_ROUTE = 7,
+    FORGED_ROUTE = 8,
+    SEEN_REQUEST = 9,
+    WORMHOLE_REQUEST = 10,
+    WORMHOLE_REPLY = 11,
+    POLLUTED_ENTRY = 12
+};
+
+static inline BlackholeFlowKey MakeFlowKey(FlowKeyKind kind, uint32_t source, uint32_t destination,
+                                           uint8_t protocol, uint16_t port) {
+    BlackholeFlowKey key;
+    key.addresses = (static_cast<uint64_t>(source) << 32) | destination;
+    key.rest = (kind << 24) | (static_cast<uint32_t>(protocol) << 16) | port;
+    return key;
+}
+
+// The port is read from the first four bytes of the L4 header, where TCP
+// and UDP both keep the destination port
+BlackholeFlowKey BlackholeAodv::MakePacketFlowKey(Ptr<const Packet> packet, const Ipv4Header &header) {
+    uint8_t protocol = header.GetProtocol();
+    uint16_t port = 0;
+    if ((protocol == 6 || protocol == 17) && header.GetFragmentOffset() == 0) {
+        uint8_t l4[4];
+        if (packet->CopyData(l4, sizeof(l4)) == sizeof(l4)) {
+            port = (static_cast<uint16_t>(l4[2]) << 8) | l4[3];
+        }
+    }
+    return MakeFlowKey(POLICY_FLOW, header.GetSource().Get(), header.GetDestination().Get(), protocol, port);
+}
+
+static inline void WriteU16(uint8_t *p, uint16_t value) {
+    p[0] = static_cast<uint8_t>(value >> 8);
+    p[1] = static_cast<uint8_t>(value);
+}
+
+static inline void WriteU32(uint8_t *p, uint32_t value) {
+    p[0] = static_cast<uint8_t>(value >> 24);
+    p[1] = static_cast<uint8_t>(value >> 16);
+    p[2] = static_cast<uint8_t>(value >> 8);
+    p[3] = static_cast<uint8_t>(value);
+}
+
+static inline uint16_t ReadU16(const uint8_t *p) {
+    return (static_cast<uint16_t>(p[0]) << 8) | p[1];
+}
+
+static inline uint32_t ReadU32(const uint8_t *p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+static inline uint32_t PrefixMask(uint32_t length) {
+    return (length == 0) ? 0 : (0xFFFFFFFFu << (32 - length));
+}
+
+namespace {
+
+// Backing store of BlackholeCollusionRegistry
+struct CollusionState {
+    static const uint32_t CAPTURE_SLOTS_LOG2 = 16;
+
+    struct Capture {
+        int64_t expires; // Time steps; free once in the past
+        uint32_t owner;  // Node id
+    };
+
+    std::vector<uint8_t> members;             // Indexed by node id
+    uint32_t nMembers = 0;
+    BlackholeFlowTable<uint32_t> addresses;   // Address -> node id
+    std::vector<Capture> captured;            // 2^CAPTURE_SLOTS_LOG2 slots
+    uint32_t nCaptured = 0;
+
+    static uint32_t CaptureSlot(Ipv4Address source, Ipv4Address destination) {
+        uint64_t x = (static_cast<uint64_t>(source.Get()) << 32) | destination.Get();
+        x *= 0x9E3779B97F4A7C15ULL;
+        return static_cast<uint32_t>(x >> (64 - CAPTURE_SLOTS_LOG2));
+    }
+};
+
+CollusionState &GetCollusionState() {
+    static CollusionState state;
+    return state;
+}
+
+const uint32_t NO_NODE = std::numeric_limits<uint32_t>::max();
+
+} // namespace
+
+bool BlackholeReadConfigLine(std::istream &is, std::string &line, uint32_t &lineNumber) {
+    while (std::getline(is, line)) {
+        lineNumber++;
+        std::string::size_type comment = line.find('#');
+        if (comment != std::string::npos) {
+            line.erase(comment);
+        }
+        if (line.find_first_not_of(" \t\r") != std::string::npos) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void BlackholeCollusionRegistry::Join(uint32_t nodeId) {
+    CollusionState &state = GetCollusionState();
+    if (nodeId >= state.members.size()) {
+        state.members.resize(nodeId + 1, 0);
+    }
+    if (!state.members[nodeId]) {
+        state.members[nodeId] = 1;
+        state.nMembers++;
+    }
+}
+
+void BlackholeCollusionRegistry::Leave(uint32_t nodeId) {
+    CollusionState &state = GetCollusionState();
+    if (nodeId < state.members.size() && state.members[nodeId]) {
+        state.members[nodeId] = 0;
+        state.nMembers--;
+    }
+}
+
+bool BlackholeCollusionRegistry::IsMember(uint32_t nodeId) {
+    const CollusionState &state = GetCollusionState();
+    return nodeId < state.members.size() && state.members[nodeId];
+}
+
+uint32_t BlackholeCollusionRegistry::GetNMembers() {
+    return GetCollusionState().nMembers;
+}
+
+void BlackholeCollusionRegistry::AddAddress(Ipv4Address address, uint32_t nodeId) {
+    GetCollusionState().addresses.Insert(MakeFlowKey(COLLUDER_ADDRESS, address.Get(), 0, 0, 0)) = nodeId;
+}
+
+void BlackholeCollusionRegistry::RemoveAddress(Ipv4Address address) {
+    // Entries are never erased from the table, only orphaned
+    uint32_t *nodeId = GetCollusionState().addresses.Find(MakeFlowKey(COLLUDER_ADDRESS, address.Get(), 0, 0, 0));
+    if (nodeId) {
+        *nodeId = NO_NODE;
+    }
+}
+
+bool BlackholeCollusionRegistry::IsMemberAddress(Ipv4Address address) {
+    CollusionState &state = GetCollusionState();
+    if (state.nMembers == 0) {
+        return false;
+    }
+    const uint32_t *nodeId = state.addresses.Find(MakeFlowKey(COLLUDER_ADDRESS, address.Get(), 0, 0, 0));
+    return nodeId && IsMember(*nodeId);
+}
+
+bool BlackholeCollusionRegistry::MarkCaptured(Ipv4Address source, Ipv4Address destination, uint32_t nodeId,
+                                              Time expires) {
+    CollusionState &state = GetCollusionState();
+    if (state.captured.empty()) {
+        state.captured.assign(1u << CollusionState::CAPTURE_SLOTS_LOG2, CollusionState::Capture{0, NO_NODE});
+    }
+    CollusionState::Capture &capture = state.captured[CollusionState::CaptureSlot(source, destination)];
+    bool held = Simulator::Now().GetTimeStep() < capture.expires;
+    if (held && capture.owner != nodeId) {
+        return false;
+    }
+    if (!held) {
+        state.nCaptured++;
+    }
+    capture.owner = nodeId;
+    capture.expires = std::max(capture.expires, expires.GetTimeStep());
+    return true;
+}
+
+bool BlackholeCollusionRegistry::IsCaptured(Ipv4Address source, Ipv4Address destination) {
+    const CollusionState &state = GetCollusionState();
+    if (state.captured.empty()) {
+        return false;
+    }
+    const CollusionState::Capture &capture = state.captured[CollusionState::CaptureSlot(source, destination)];
+    return Simulator::Now().GetTimeStep() < capture.expires;
+}
+
+uint32_t BlackholeCollusionRegistry::GetNCaptured() {
+    return GetCollusionState().nCaptured;
+}
+
+void BlackholeCollusionRegistry::Clear() {
+    CollusionState &state = GetCollusionState();
+    state.members.clear();
+    state.nMembers = 0;
+    state.addresses.Clear();
+    state.captured.clear();
+    state.nCaptured = 0;
+}
+
 TypeId BlackholeAodv::GetTypeId(void) {
     static TypeId tid = TypeId("ns3::BlackholeAodv")
         .SetParent<Ipv4RoutingProtocol>()
@@ -15,54 +322,1580 @@ TypeId BlackholeAodv::GetTypeId(void) {
         .AddAttribute("DropProbability",
                       "Probability of dropping packets",
                       DoubleValue(1.0), // Default to 90% drop rate
-                      MakeDoubleAccessor(&BlackholeAodv::dropProbability),
-                      MakeDoubleChecker<double>(0.0, 1.0));
+                      MakeDoubleAccessor(&BlackholeAodv::SetDropProbability,
+                                         &BlackholeAodv::GetDropProbability),
+                      MakeDoubleChecker<double>(0.0, 1.0))
+        .AddAttribute("DropModel",
+                      "Model of the global drop decision",
+                      EnumValue<DropModel>(BERNOULLI),
+                      MakeEnumAccessor<DropModel>(&BlackholeAodv::m_dropModel),
+                      MakeEnumChecker(BERNOULLI, "Bernoulli",
+                                      GILBERT_ELLIOTT, "GilbertElliott"))
+        .AddAttribute("GoodDropProbability",
+                      "Gilbert-Elliott drop probability in the good state",
+                      DoubleValue(0.0),
+                      MakeDoubleAccessor(&BlackholeAodv::SetGoodDropProbability,
+                                         &BlackholeAodv::GetGoodDropProbability),
+                      MakeDoubleChecker<double>(0.0, 1.0))
+        .AddAttribute("BadDropProbability",
+                      "Gilbert-Elliott drop probability in the bad state",
+                      DoubleValue(1.0),
+                      MakeDoubleAccessor(&BlackholeAodv::SetBadDropProbability,
+                                         &BlackholeAodv::GetBadDropProbability),
+                      MakeDoubleChecker<double>(0.0, 1.0))
+        .AddAttribute("GoodToBadProbability",
+                      "Per-packet probability of entering the bad state",
+                      DoubleValue(0.01),
+                      MakeDoubleAccessor(&BlackholeAodv::SetGoodToBadProbability,
+                                         &BlackholeAodv::GetGoodToBadProbability),
+                      MakeDoubleChecker<double>(0.0, 1.0))
+        .AddAttribute("BadToGoodProbability",
+                      "Per-packet probability of leaving the bad state",
+                      DoubleValue(0.1),
+                      MakeDoubleAccessor(&BlackholeAodv::SetBadToGoodProbability,
+                                         &BlackholeAodv::GetBadToGoodProbability),
+                      MakeDoubleChecker<double>(0.0, 1.0))
+        .AddAttribute("ActiveStart",
+                      "Start of the periodic on/off activity pattern",
+                      TimeValue(Seconds(0)),
+                      MakeTimeAccessor(&BlackholeAodv::SetActiveStart,
+                                       &BlackholeAodv::GetActiveStart),
+                      MakeTimeChecker())
+        .AddAttribute("ActiveOn",
+                      "Active part of each period (zero: no periodic pattern)",
+                      TimeValue(Seconds(0)),
+                      MakeTimeAccessor(&BlackholeAodv::SetActiveOn,
+                                       &BlackholeAodv::GetActiveOn),
+                      MakeTimeChecker())
+        .AddAttribute("ActiveOff",
+                      "Inactive part of each period",
+                      TimeValue(Seconds(0)),
+                      MakeTimeAccessor(&BlackholeAodv::SetActiveOff,
+                                       &BlackholeAodv::GetActiveOff),
+                      MakeTimeChecker())
+        .AddAttribute("ScheduleFile",
+                      "File of active intervals loaded on set",
+                      StringValue(""),
+                      MakeStringAccessor(&BlackholeAodv::SetScheduleFile,
+                                         &BlackholeAodv::GetScheduleFile),
+                      MakeStringChecker())
+        .AddAttribute("DelayProbability",
+                      "Fraction of forwarded packets held back by the jellyfish timer wheel",
+                      DoubleValue(0.0),
+                      MakeDoubleAccessor(&BlackholeAodv::SetDelayProbability,
+                                         &BlackholeAodv::GetDelayProbability),
+                      MakeDoubleChecker<double>(0.0, 1.0))
+        .AddAttribute("DelayVariable",
+                      "Delay in seconds applied to held-back packets",
+                      StringValue("ns3::UniformRandomVariable[Min=0.05|Max=0.2]"),
+                      MakePointerAccessor(&BlackholeAodv::m_delayVariable),
+                      MakePointerChecker<RandomVariableStream>())
+        .AddAttribute("DelayTick",
+                      "Granularity of the jellyfish timer wheel; delays are rounded up to it",
+                      TimeValue(MilliSeconds(5)),
+                      MakeTimeAccessor(&BlackholeAodv::m_delayTick),
+                      MakeTimeChecker())
+        .AddAttribute("MaxDelayedPackets",
+                      "Number of packets the timer wheel may hold; beyond it packets are not delayed",
+                      UintegerValue(4096),
+                      MakeUintegerAccessor(&BlackholeAodv::m_maxDelayedPackets),
+                      MakeUintegerChecker<uint32_t>())
+        .AddAttribute("TunnelDataRate",
+                      "Capacity of the wormhole tunnel to the peer, 0 for unlimited",
+                      DataRateValue(DataRate(0)),
+                      MakeDataRateAccessor(&BlackholeAodv::m_tunnelDataRate),
+                      MakeDataRateChecker())
+        .AddAttribute("TunnelDelay",
+                      "Propagation delay of the wormhole tunnel",
+                      TimeValue(Seconds(0)),
+                      MakeTimeAccessor(&BlackholeAodv::m_tunnelDelay),
+                      MakeTimeChecker())
+        .AddAttribute("TunnelQueueLimit",
+                      "Packets that may be in flight through the tunnel at once",
+                      UintegerValue(1000),
+                      MakeUintegerAccessor(&BlackholeAodv::m_tunnelQueueLimit),
+                      MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("ForgeRreps",
+                      "Answer every RREQ heard with a forged RREP to attract routes",
+                      BooleanValue(true),
+                      MakeBooleanAccessor(&BlackholeAodv::m_forgeRreps),
+                      MakeBooleanChecker())
+        .AddAttribute("RushRreqs",
+                      "Rebroadcast RREQs immediately instead of after AODV's jitter",
+                      BooleanValue(false),
+                      MakeBooleanAccessor(&BlackholeAodv::m_rushRreqs),
+                      MakeBooleanChecker())
+        .AddAttribute("MaxSpoofedIdentities",
+                      "Cap on the identities advertised through spoofed HELLOs",
+                      UintegerValue(256),
+                      MakeUintegerAccessor(&BlackholeAodv::m_maxSpoofedIdentities),
+                      MakeUintegerChecker<uint32_t>())
+        .AddAttribute("SpoofedHelloInterval",
+                      "Interval between batches of spoofed HELLOs",
+                      TimeValue(Seconds(1)),
+                      MakeTimeAccessor(&BlackholeAodv::m_spoofedHelloInterval),
+                      MakeTimeChecker())
+        .AddAttribute("ForgedHopCount",
+                      "Hop count to the destination claimed in forged RREPs",
+                      UintegerValue(1),
+                      MakeUintegerAccessor(&BlackholeAodv::SetForgedHopCount,
+                                           &BlackholeAodv::GetForgedHopCount),
+                      MakeUintegerChecker<uint8_t>())
+        .AddAttribute("SeqNoBoost",
+                      "Amount added to the requested destination sequence number in forged RREPs",
+                      UintegerValue(100),
+                      MakeUintegerAccessor(&BlackholeAodv::m_seqNoBoost),
+                      MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("ForgedLifetime",
+                      "Route lifetime advertised in forged RREPs",
+                      TimeValue(Seconds(10)),
+                      MakeTimeAccessor(&BlackholeAodv::SetForgedLifetime,
+                                       &BlackholeAodv::GetForgedLifetime),
+                      MakeTimeChecker())
+        .AddAttribute("Collude",
+                      "Join the simulation-wide collusion registry: spare colluders' "
+                      "traffic and leave flows a colluder has captured to it",
+                      BooleanValue(false),
+                      MakeBooleanAccessor(&BlackholeAodv::m_collude),
+                      MakeBooleanChecker())
+        .AddAttribute("RouteCacheLifetime",
+                      "How long a route for locally originated packets is reused without asking AODV, "
+                      "0 to disable the cache",
+                      TimeValue(MilliSeconds(500)),
+                      MakeTimeAccessor(&BlackholeAodv::m_routeCacheLifetime),
+                      MakeTimeChecker())
+        .AddAttribute("MaxCachedRoutes",
+                      "Destinations the route cache holds before it is flushed",
+                      UintegerValue(1024),
+                      MakeUintegerAccessor(&BlackholeAodv::m_maxCachedRoutes),
+                      MakeUintegerChecker<uint32_t>(1))
+        .AddAttribute("BlockDecisions",
+                      "Precompute drop decisions in blocks of 4096 instead of one draw per packet",
+                      BooleanValue(true),
+                      MakeBooleanAccessor(&BlackholeAodv::m_blockDecisions),
+                      MakeBooleanChecker())
+        .AddAttribute("PolicyFile",
+                      "File of per-flow, per-source and per-prefix drop rules loaded on set",
+                      StringValue(""),
+                      MakeStringAccessor(&BlackholeAodv::SetPolicyFile,
+                                         &BlackholeAodv::GetPolicyFile),
+                      MakeStringChecker())
+        .AddAttribute("FlowAccounting",
+                      "Keep packet and byte counters per flow and per input interface",
+                      BooleanValue(true),
+                      MakeBooleanAccessor(&BlackholeAodv::m_flowAccounting),
+                      MakeBooleanChecker())
+        .AddAttribute("MaxTrackedFlows",
+                      "Number of distinct flows given their own counters; later flows are aggregated",
+                      UintegerValue(65536),
+                      MakeUintegerAccessor(&BlackholeAodv::m_maxTrackedFlows),
+                      MakeUintegerChecker<uint32_t>())
+        .AddAttribute("EventRingSize",
+                      "Number of drop/forward records kept in the in-memory event ring (0 disables it)",
+                      UintegerValue(0),
+                      MakeUintegerAccessor(&BlackholeAodv::SetEventRingSize,
+                                           &BlackholeAodv::GetEventRingSize),
+                      MakeUintegerChecker<uint32_t>())
+        .AddTraceSource("PacketDropped",
+                        "A transit packet was dropped by the blackhole",
+                        MakeTraceSourceAccessor(&BlackholeAodv::m_packetDroppedTrace),
+                        "ns3::BlackholeAodv::PacketDecisionTracedCallback")
+        .AddTraceSource("PacketForwarded",
+                        "A transit packet was let through by the blackhole",
+                        MakeTraceSourceAccessor(&BlackholeAodv::m_packetForwardedTrace),
+                        "ns3::BlackholeAodv::PacketDecisionTracedCallback");
     return tid;
 }
 
 BlackholeAodv::BlackholeAodv()
-    : totalDroppedPackets(0),
+    : m_routeCacheLifetime(MilliSeconds(500)),
+      m_maxCachedRoutes(1024),
+      m_routeGeneration(0),
+      m_routeCacheHits(0),
+      m_routeCacheMisses(0),
+      totalDroppedPackets(0),
       totalForwardedPackets(0),
-      dropProbability(1.0) {
-    // Initialize random variable for drop decisions
-    m_randomVar = CreateObject<UniformRandomVariable>();
-    m_randomVar->SetAttribute("Min", DoubleValue(0.0));
-    m_randomVar->SetAttribute("Max", DoubleValue(1.0));
+      totalDroppedBytes(0),
+      totalForwardedBytes(0),
+      dropProbability(1.0),
+      m_dropThreshold(ProbabilityToThreshold(1.0)),
+      m_dropModel(BERNOULLI),
+      m_burstBad(false),
+      m_goodDropProbability(0.0),
+      m_badDropProbability(1.0),
+      m_goodToBadProbability(0.01),
+      m_badToGoodProbability(0.1),
+      m_intervalCursor(0),
+      m_activeStart(Seconds(0)),
+      m_activeOn(Seconds(0)),
+      m_activeOff(Seconds(0)),
+      m_active(true),
+      m_nextTransition(std::numeric_limits<int64_t>::max()),
+      m_forgeRreps(true),
+      m_collude(false),
+      m_rrepsYielded(0),
+      m_rushRreqs(false),
+      m_rreqsRushed(0),
+      m_rushesWon(0),
+      m_maxSpoofedIdentities(256),
+      m_spoofedHelloInterval(Seconds(1)),
+      m_spoofedHellosSent(0),
+      m_spoofedArpReplies(0),
+      m_forgedHopCount(1),
+      m_seqNoBoost(100),
+      m_forgedLifetime(Seconds(10)),
+      m_rreqsSeen(0),
+      m_rrepsForged(0),
+      m_nodeId(0),
+      m_delayProbability(0.0),
+      m_delayThreshold(0),
+      m_delayTick(MilliSeconds(5)),
+      m_maxDelayedPackets(4096),
+      m_delayFree(WHEEL_NONE),
+      m_wheel0Count(0),
+      m_wheel1Count(0),
+      m_wheelNow(0),
+      m_wheelScheduledTick(-1),
+      m_delayedPackets(0),
+      m_delayOverflows(0),
+      m_tunnelDataRate(0),
+      m_tunnelDelay(Seconds(0)),
+      m_tunnelQueueLimit(1000),
+      m_tunnelInFlight(0),
+      m_tunnelBusyUntil(Seconds(0)),
+      m_tunnelledPackets(0),
+      m_tunnelledBytes(0),
+      m_tunnelDrops(0),
+      m_tunnelExitDrops(0),
+      m_tunnelledControl(0),
+      m_tunnelLatencySum(Seconds(0)),
+      m_tunnelMaxLatency(Seconds(0)),
+      m_rngRun(RngSeedManager::GetRun()),
+      m_packetCounter(0),
+      m_blockDecisions(true),
+      m_decisionBase(0),
+      m_decisionIndex(DECISION_BLOCK_BITS),
+      m_prefixLengths(0),
+      m_flowAccounting(true),
+      m_maxTrackedFlows(65536),
+      m_untrackedFlows(),
+      m_eventRingPos(0),
+      m_eventRingWritten(0) {
+    m_currentUcb = nullptr;
+    m_forwardFilter = MakeCallback(&BlackholeAodv::FilterForward, this);
+    // Keyed on the run seed here; the node id is folded in by SetIpv4
+    m_rngKey[0] = RngSeedManager::GetSeed();
+    m_rngKey[1] = 0;
+    UpdateBurstThresholds();
+    BuildRrepTemplate();
+    std::fill(m_wheel0, m_wheel0 + WHEEL0_SLOTS, WHEEL_NONE);
+    std::fill(m_wheel1, m_wheel1 + WHEEL1_SLOTS, WHEEL_NONE);
+    std::fill(m_wheel0Occupied, m_wheel0Occupied + WHEEL0_SLOTS / 64, 0);
     NS_LOG_INFO("BlackholeAodv: Initialized with drop probability = " << dropProbability);
+
+#ifdef NS3_LOG_ENABLE
+    // Per-packet logging is a trace subscriber so RouteInput never formats
+    // addresses unless somebody asked for them.
+    if (g_log.IsEnabled(LOG_WARN)) {
+        m_packetDroppedTrace.ConnectWithoutContext(MakeCallback(&LogPacketDecision));
+    }
+    if (g_log.IsEnabled(LOG_INFO)) {
+        m_packetForwardedTrace.ConnectWithoutContext(MakeCallback(&LogPacketDecision));
+    }
+#endif
 }
 
 BlackholeAodv::~BlackholeAodv() {}
 
-Ptr<Ipv4Route> BlackholeAodv::RouteOutput(Ptr<Packet>, const Ipv4Header &, Ptr<NetDevice>, Socket::SocketErrno &sockerr) {
-    NS_LOG_WARN("BlackholeAodv: RouteOutput called but not supported (returning nullptr).");
-    sockerr = Socket::ERROR_NOROUTETOHOST;
-    return nullptr; // Blackhole does not provide routes
+void BlackholeAodv::DoDispose() {
+    // Packets still held by the timer wheel are discarded with it
+    m_wheelEvent.Cancel();
+    m_delayPool.clear();
+    m_delayUcb = UnicastForwardCallback();
+    m_delayVariable = nullptr;
+    m_replyRoutes.clear();
+    m_rushedRequests.Clear();
+    m_seenRequests.Clear();
+    m_wormholeRequests.Clear();
+    m_wormholeReplies.Clear();
+    m_forgedRoutes.Clear();
+    m_helloEvent.Cancel();
+    m_spoofedIdentities.clear();
+    m_spoofedHellos.clear();
+    m_neighborsHeard.Clear();
+    m_pollutedEntries.Clear();
+    m_arpDevices.clear();
+    m_wormholePeer = nullptr; // Breaks the reference cycle between the ends
+    if (m_collude && m_ipv4) {
+        Ptr<Node> node = m_ipv4->GetObject<Node>();
+        if (node) {
+            BlackholeCollusionRegistry::Leave(node->GetId());
+        }
+    }
+    m_aodv = nullptr;
+    m_ipv4 = nullptr;
+    m_loopback = nullptr;
+    m_forwardFilter = UnicastForwardCallback();
+    m_routeCache.Clear();
+    Ipv4RoutingProtocol::DoDispose();
+}
+
+void BlackholeAodv::SetAodv(Ptr<aodv::RoutingProtocol> aodv) {
+    m_aodv = aodv;
+}
+
+Ptr<aodv::RoutingProtocol> BlackholeAodv::GetAodv() const {
+    return m_aodv;
+}
+
+Ptr<Ipv4Route> BlackholeAodv::RouteOutput(Ptr<Packet> packet, const Ipv4Header &header,
+                                          Ptr<NetDevice> oif, Socket::SocketErrno &sockerr) {
+    // Packets bound to a device (AODV's own control traffic among them)
+    // always go to AODV
+    if (oif || m_routeCacheLifetime.IsZero()) {
+        return m_aodv->RouteOutput(packet, header, oif, sockerr);
+    }
+    int64_t now = Simulator::Now().GetTimeStep();
+    BlackholeFlowKey key = MakeFlowKey(CACHED_ROUTE, 0, header.GetDestination().Get(), 0, 0);
+    CachedRoute *cached = m_routeCache.Find(key);
+    if (cached && cached->generation == m_routeGeneration && now < cached->expires) {
+        m_routeCacheHits++;
+        sockerr = Socket::ERROR_NOTERROR;
+        return cached->route;
+    }
+    m_routeCacheMisses++;
+    Ptr<Ipv4Route> route = m_aodv->RouteOutput(packet, header, oif, sockerr);
+    // Without a route AODV hands out a loopback route that defers the
+    // packet until discovery completes; that one must not be reused
+    if (!route || sockerr != Socket::ERROR_NOTERROR || route->GetOutputDevice() == m_loopback) {
+        return route;
+    }
+    if (!cached && m_routeCache.GetSize() >= m_maxCachedRoutes) {
+        m_routeCache.Clear();
+    }
+    // AODV extends the route to at least ActiveRouteTimeout on this call,
+    // and drops it once AllowedHelloLoss HELLOs of the next hop are missed
+    TimeValue activeRouteTimeout;
+    m_aodv->GetAttribute("ActiveRouteTimeout", activeRouteTimeout);
+    int64_t expires = now + std::min(m_routeCacheLifetime, activeRouteTimeout.Get()).GetTimeStep();
+    const int64_t *heard = m_neighborsHeard.Find(MakeFlowKey(HEARD_NEIGHBOR, route->GetGateway().Get(), 0, 0, 0));
+    BooleanValue enableHello;
+    m_aodv->GetAttribute("EnableHello", enableHello);
+    if (heard && enableHello.Get()) {
+        UintegerValue allowedHelloLoss;
+        TimeValue helloInterval;
+        m_aodv->GetAttribute("AllowedHelloLoss", allowedHelloLoss);
+        m_aodv->GetAttribute("HelloInterval", helloInterval);
+        expires = std::min(expires, *heard + static_cast<int64_t>(allowedHelloLoss.Get()) *
+                                                 helloInterval.Get().GetTimeStep());
+    }
+    CachedRoute &entry = cached ? *cached : m_routeCache.Insert(key);
+    entry.route = route;
+    entry.expires = expires;
+    entry.generation = m_routeGeneration;
+    return route;
+}
+
+void BlackholeAodv::InvalidateRouteCache() {
+    m_routeGeneration++;
+}
+
+bool BlackholeAodv::IsRouteChange(Ptr<const Packet> packet) const {
+    uint32_t size = packet->GetSize();
+    if (size < 9) {
+        return false;
+    }
+    uint8_t datagram[RREP_DATAGRAM_SIZE];
+    packet->CopyData(datagram, 9);
+    if (datagram[8] == aodv::AODVTYPE_RERR) {
+        return true;
+    }
+    if (datagram[8] != aodv::AODVTYPE_RREP || size != RREP_DATAGRAM_SIZE) {
+        return false;
+    }
+    // HELLOs (destination == originator) only refresh neighbours
+    packet->CopyData(datagram, RREP_DATAGRAM_SIZE);
+    return ReadU32(datagram + 9 + 3) != ReadU32(datagram + 9 + 11);
+}
+
+uint64_t BlackholeAodv::GetRouteCacheHits() const {
+    return m_routeCacheHits;
+}
+
+uint64_t BlackholeAodv::GetRouteCacheMisses() const {
+    return m_routeCacheMisses;
 }
 
 bool BlackholeAodv::RouteInput(Ptr<const Packet> packet,
                                const Ipv4Header &header,
-                               Ptr<const NetDevice>,
-                               const UnicastForwardCallback &,
-                               const MulticastForwardCallback &,
-                               const LocalDeliverCallback &,
-                               const ErrorCallback &) {
-    NS_LOG_INFO("BlackholeAodv: Packet from " << header.GetSource() 
-                << " to " << header.GetDestination());
-
-    double randomValue = m_randomVar->GetValue();
-    NS_LOG_INFO("Random drop value: " << randomValue << " (Drop Probability: " << dropProbability << ")");
-
-    if (randomValue <= dropProbability) {
+                               Ptr<const NetDevice> idev,
+                               const UnicastForwardCallback &ucb,
+                               const MulticastForwardCallback &mcb,
+                               const LocalDeliverCallback &lcb,
+                               const ErrorCallback &ecb) {
+    // Packets looped back by AODV's deferred RouteOutput are our own traffic,
+    // and AODV may queue their callbacks, so they bypass the filter.
+    if (idev == m_loopback) {
+        return m_aodv->RouteInput(packet, header, idev, ucb, mcb, lcb, ecb);
+    }
+    switch (Classify(packet, header)) {
+    case PACKET_CONTROL:
+        return RouteControl(packet, header, idev, ucb, mcb, lcb, ecb);
+    case PACKET_BROADCAST:
+        // AODV re-broadcasts broadcast data and leaves multicast to the
+        // caller; the attacker touches neither
+        return m_aodv->RouteInput(packet, header, idev, ucb, mcb, lcb, ecb);
+    case PACKET_LOCAL:
+        // Never dropped nor accounted. This skips AODV's refresh of the
+        // route back to the sender on data receipt.
+        lcb(packet, header, m_ipv4->GetInterfaceForDevice(idev));
+        return true;
+    case PACKET_DATA:
+        break;
+    }
+    // AODV invokes the unicast forward callback synchronously for transit
+    // packets, so the caller's callback only needs to live for this call.
+    m_currentUcb = &ucb;
+    m_currentIdev = idev;
+    bool handled;
+    if (m_forgedRoutes.GetSize() != 0 && IsForgedDestination(header.GetDestination())) {
+        // AODV rarely has a real route to a forged destination; its
+        // RouteInput would send a RERR that tears the forged route down and
+        // drop the packet. The route comes from RouteOutput instead: without
+        // a route it is the loopback route, and the tagged copy forwarded
+        // over it is queued by AODV while a route discovery runs. AODV
+        // stamps our address as the source of a packet it dequeues.
+        Ptr<Packet> copy = packet->Copy();
+        Socket::SocketErrno sockerr = Socket::ERROR_NOTERROR;
+        Ptr<Ipv4Route> route = m_aodv->RouteOutput(copy, header, nullptr, sockerr);
+        handled = route != nullptr;
+        if (handled) {
+            m_forwardFilter(route, copy, header);
+        }
+    } else {
+        handled = m_aodv->RouteInput(packet, header, idev, m_forwardFilter, mcb, lcb, ecb);
+    }
+    m_currentUcb = nullptr;
+    m_currentIdev = nullptr;
+    return handled;
+}
+
+BlackholeAodv::PacketClass BlackholeAodv::Classify(Ptr<const Packet> packet, const Ipv4Header &header) const {
+    // AODV control is recognised whatever the destination: AODV sends from
+    // and to its own port, and the first byte after the UDP header is a
+    // message type. Data merely addressed to port 654 stays data, so it
+    // cannot slip past the filter. Later fragments carry no UDP header.
+    if (header.GetProtocol() == 17 && header.GetFragmentOffset() == 0 && packet->GetSize() >= 9) {
+        uint8_t start[9];
+        packet->CopyData(start, sizeof(start));
+        if (ReadU16(start) == aodv::RoutingProtocol::AODV_PORT &&
+            ReadU16(start + 2) == aodv::RoutingProtocol::AODV_PORT && start[8] >= aodv::AODVTYPE_RREQ &&
+            start[8] <= aodv::AODVTYPE_RREP_ACK) {
+            return PACKET_CONTROL;
+        }
+    }
+    Ipv4Address destination = header.GetDestination();
+    if (destination.IsBroadcast() || destination.IsMulticast() || IsBroadcastAddress(destination)) {
+        return PACKET_BROADCAST;
+    }
+    return IsLocalAddress(destination) ? PACKET_LOCAL : PACKET_DATA;
+}
+
+bool BlackholeAodv::RouteControl(Ptr<const Packet> packet,
+                                 const Ipv4Header &header,
+                                 Ptr<const NetDevice> idev,
+                                 const UnicastForwardCallback &ucb,
+                                 const MulticastForwardCallback &mcb,
+                                 const LocalDeliverCallback &lcb,
+                                 const ErrorCallback &ecb) {
+    // An RREQ is the only AODV message of exactly this size; answer or rush
+    // it before AODV gets to rebroadcast it. A rushed RREQ is handed to AODV
+    // with TTL 1, so AODV still learns the reverse route but does not
+    // rebroadcast it a second time.
+    const Ipv4Header *aodvHeader = &header;
+    Ipv4Header rushedHeader;
+    uint32_t size = packet->GetSize();
+    if (size == RREQ_DATAGRAM_SIZE) {
+        if ((m_forgeRreps || m_rushRreqs || m_wormholePeer) && HandleRequest(packet, header, idev)) {
+            rushedHeader = header;
+            rushedHeader.SetTtl(1);
+            aodvHeader = &rushedHeader;
+        }
+    } else if (size == RREP_DATAGRAM_SIZE &&
+               (m_rushRreqs || m_wormholePeer || !m_spoofedHellos.empty() || !m_routeCacheLifetime.IsZero())) {
+        ObserveReply(packet, header);
+    }
+    if (m_routeCache.GetSize() != 0 && IsRouteChange(packet)) {
+        InvalidateRouteCache();
+    }
+    // Control is never filtered; AODV forwards replies and errors through
+    // its own sockets
+    return m_aodv->RouteInput(packet, *aodvHeader, idev, ucb, mcb, lcb, ecb);
+}
+
+void BlackholeAodv::FilterForward(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header) {
+    FilterWith<ScheduledDrop<SelectiveDrop>, AttributeAccounting, FullTrace, JellyfishForward>(route, packet,
+                                                                                               header);
+}
+
+void BlackholeAodv::ForwardUnfiltered(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header) {
+    (*m_currentUcb)(route, packet, header);
+}
+
+void BlackholeAodv::SetForwardFilter(UnicastForwardCallback filter) {
+    m_forwardFilter = filter;
+}
+
+void BlackholeAodv::CountTotals(uint32_t bytes, bool dropped) {
+    if (dropped) {
         totalDroppedPackets++;
-        NS_LOG_WARN("BlackholeAodv: Dropped packet from " << header.GetSource() 
-                    << " to " << header.GetDestination());
-        return false; // Drop the packet
+        totalDroppedBytes += bytes;
+    } else {
+        totalForwardedPackets++;
+        totalForwardedBytes += bytes;
+    }
+}
+
+uint64_t BlackholeAodv::NextRandom() {
+    return Philox4x32(m_packetCounter++, m_rngRun, m_rngKey[0], m_rngKey[1]);
+}
+
+bool BlackholeAodv::NextDropDecision() {
+    if (!m_blockDecisions) {
+        return (NextRandom() >> 1) < m_dropThreshold;
+    }
+    if (m_decisionIndex == DECISION_BLOCK_BITS) {
+        RefillDecisionBlock();
+    }
+    uint32_t index = m_decisionIndex++;
+    return (m_decisionBits[index >> 6] >> (index & 63)) & 1;
+}
+
+uint64_t BlackholeAodv::NextAlignedRandom() {
+    uint64_t counter = (m_decisionIndex < DECISION_BLOCK_BITS) ? m_decisionBase + m_decisionIndex++
+                                                               : m_packetCounter++;
+    return Philox4x32(counter, m_rngRun, m_rngKey[0], m_rngKey[1]);
+}
+
+bool BlackholeAodv::NextDropDecision(uint64_t threshold) {
+    if (threshold == m_dropThreshold) {
+        return NextDropDecision();
+    }
+    return (NextAlignedRandom() >> 1) < threshold;
+}
+
+bool BlackholeAodv::NextBurstDecision() {
+    // Low half decides the drop in the current state, high half the transition
+    uint64_t draw = NextAlignedRandom();
+    uint64_t dropDraw = draw & 0xFFFFFFFFu;
+    uint64_t transitionDraw = draw >> 32;
+    bool drop = dropDraw < (m_burstBad ? m_badDropThreshold : m_goodDropThreshold);
+    m_burstBad = m_burstBad ? (transitionDraw >= m_badToGoodThreshold)
+                            : (transitionDraw < m_goodToBadThreshold);
+    return drop;
+}
+
+void BlackholeAodv::UpdateBurstThresholds() {
+    m_goodDropThreshold = ProbabilityToThreshold32(m_goodDropProbability);
+    m_badDropThreshold = ProbabilityToThreshold32(m_badDropProbability);
+    m_goodToBadThreshold = ProbabilityToThreshold32(m_goodToBadProbability);
+    m_badToGoodThreshold = ProbabilityToThreshold32(m_badToGoodProbability);
+}
+
+bool BlackholeAodv::IsActive() {
+    int64_t now = Simulator::Now().GetTimeStep();
+    if (now >= m_nextTransition) {
+        AdvanceSchedule(now);
+    }
+    return m_active;
+}
+
+void BlackholeAodv::AdvanceSchedule(int64_t now) {
+    const int64_t never = std::numeric_limits<int64_t>::max();
+    if (!m_intervals.empty()) {
+        while (m_intervalCursor < m_intervals.size() && m_intervals[m_intervalCursor].stop <= now) {
+            m_intervalCursor++;
+        }
+        if (m_intervalCursor == m_intervals.size()) {
+            m_active = false;
+            m_nextTransition = never;
+        } else if (now < m_intervals[m_intervalCursor].start) {
+            m_active = false;
+            m_nextTransition = m_intervals[m_intervalCursor].start;
+        } else {
+            m_active = true;
+            m_nextTransition = m_intervals[m_intervalCursor].stop;
+        }
+        return;
+    }
+    int64_t on = m_activeOn.GetTimeStep();
+    if (on <= 0) {
+        m_active = true;
+        m_nextTransition = never;
+        return;
+    }
+    int64_t start = m_activeStart.GetTimeStep();
+    int64_t period = on + std::max<int64_t>(m_activeOff.GetTimeStep(), 0);
+    if (now < start) {
+        m_active = false;
+        m_nextTransition = start;
+        return;
+    }
+    int64_t phase = (now - start) % period;
+    m_active = phase < on;
+    m_nextTransition = now - phase + (m_active ? on : period);
+}
+
+void BlackholeAodv::ResetSchedule() {
+    m_intervalCursor = 0;
+    m_nextTransition = std::numeric_limits<int64_t>::min();
+}
+
+const uint64_t *BlackholeAodv::FindPolicyThreshold(const BlackholeFlowKey &flow) {
+    uint32_t source = static_cast<uint32_t>(flow.addresses >> 32);
+    uint32_t destination = static_cast<uint32_t>(flow.addresses);
+
+    const uint64_t *threshold = m_policies.Find(flow);
+    if (threshold) {
+        return threshold;
+    }
+    threshold = m_policies.Find(MakeFlowKey(POLICY_SOURCE, source, 0, 0, 0));
+    if (threshold) {
+        return threshold;
+    }
+    for (int length = 32; length >= 0 && m_prefixLengths != 0; --length) {
+        if (m_prefixLengths & (1ull << length)) {
+            threshold = m_policies.Find(MakeFlowKey(POLICY_DESTINATION, 0, destination & PrefixMask(length),
+                                                    0, length));
+            if (threshold) {
+                return threshold;
+            }
+        }
+    }
+    return nullptr;
+}
+
+void BlackholeAodv::RefillDecisionBlock() {
+    uint64_t draws[64];
+    m_decisionBase = m_packetCounter;
+    for (uint32_t word = 0; word < DECISION_BLOCK_WORDS; ++word) {
+        Philox4x32Batch64(m_decisionBase + word * 64, m_rngRun, m_rngKey[0], m_rngKey[1], draws);
+        uint64_t bits = 0;
+        for (uint32_t lane = 0; lane < 64; ++lane) {
+            bits |= static_cast<uint64_t>((draws[lane] >> 1) < m_dropThreshold) << lane;
+        }
+        m_decisionBits[word] = bits;
+    }
+    m_packetCounter = m_decisionBase + DECISION_BLOCK_BITS;
+    m_decisionIndex = 0;
+}
+
+void BlackholeAodv::ResetDecisionBlock() {
+    if (m_decisionIndex < DECISION_BLOCK_BITS) {
+        // Rewind to the first unconsumed counter so the stream stays identical
+        m_packetCounter = m_decisionBase + m_decisionIndex;
+        m_decisionIndex = DECISION_BLOCK_BITS;
+    }
+}
+
+void BlackholeAodv::Account(const BlackholeFlowKey &flow, Ptr<const NetDevice> idev,
+                            uint32_t bytes, bool dropped) {
+    Counters *counters = m_flowStats.Find(flow);
+    if (!counters) {
+        counters = (m_flowStats.GetSize() < m_maxTrackedFlows) ? &m_flowStats.Insert(flow) : &m_untrackedFlows;
+    }
+    counters->Add(bytes, dropped);
+
+    int32_t interface = m_ipv4 ? m_ipv4->GetInterfaceForDevice(idev) : -1;
+    if (interface >= 0) {
+        if (static_cast<uint32_t>(interface) >= m_interfaceStats.size()) {
+            m_interfaceStats.resize(interface + 1, Counters());
+        }
+        m_interfaceStats[interface].Add(bytes, dropped);
+    }
+}
+
+void BlackholeAodv::Snapshot(AccountingSnapshot &snapshot) const {
+    snapshot.time = Simulator::Now();
+    snapshot.total.droppedPackets = totalDroppedPackets;
+    snapshot.total.droppedBytes = totalDroppedBytes;
+    snapshot.total.forwardedPackets = totalForwardedPackets;
+    snapshot.total.forwardedBytes = totalForwardedBytes;
+    snapshot.untrackedFlows = m_untrackedFlows;
+    snapshot.interfaces.assign(m_interfaceStats.begin(), m_interfaceStats.end());
+    snapshot.flows.clear();
+    snapshot.flows.reserve(m_flowStats.GetSize());
+    m_flowStats.ForEach([&snapshot](const BlackholeFlowKey &key, const Counters &counters) {
+        FlowStats stats;
+        stats.source = Ipv4Address(static_cast<uint32_t>(key.addresses >> 32));
+        stats.destination = Ipv4Address(static_cast<uint32_t>(key.addresses));
+        stats.protocol = static_cast<uint8_t>(key.rest >> 16);
+        stats.destinationPort = static_cast<uint16_t>(key.rest);
+        stats.counters = counters;
+        snapshot.flows.push_back(stats);
+    });
+}
+
+void BlackholeAodv::RecordEvent(Ptr<const Packet> packet, const Ipv4Header &header, bool dropped) {
+    EventRecord &record = m_eventRing[m_eventRingPos];
+    record.timeNs = Simulator::Now().GetNanoSeconds();
+    record.source = header.GetSource().Get();
+    record.destination = header.GetDestination().Get();
+    record.size = packet->GetSize();
+    record.protocol = header.GetProtocol();
+    record.dropped = dropped ? 1 : 0;
+    record.reserved = 0;
+    if (++m_eventRingPos == m_eventRing.size()) {
+        m_eventRingPos = 0;
+    }
+    m_eventRingWritten++;
+}
+
+bool BlackholeAodv::AddFlowPolicy(Ipv4Address source, Ipv4Address destination,
+                                  uint8_t protocol, uint16_t destinationPort, double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid drop probability " << probability << " for flow rule; ignored.");
+        return false;
+    }
+    m_policies.Insert(MakeFlowKey(POLICY_FLOW, source.Get(), destination.Get(), protocol, destinationPort)) =
+        ProbabilityToThreshold(probability);
+    return true;
+}
+
+bool BlackholeAodv::AddSourcePolicy(Ipv4Address source, double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid drop probability " << probability << " for source rule; ignored.");
+        return false;
+    }
+    m_policies.Insert(MakeFlowKey(POLICY_SOURCE, source.Get(), 0, 0, 0)) = ProbabilityToThreshold(probability);
+    return true;
+}
+
+bool BlackholeAodv::AddDestinationPolicy(Ipv4Address prefix, Ipv4Mask mask, double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid drop probability " << probability << " for prefix rule; ignored.");
+        return false;
+    }
+    uint16_t length = mask.GetPrefixLength();
+    m_policies.Insert(MakeFlowKey(POLICY_DESTINATION, 0, prefix.Get() & PrefixMask(length), 0, length)) =
+        ProbabilityToThreshold(probability);
+    m_prefixLengths |= 1ull << length;
+    return true;
+}
+
+void BlackholeAodv::ClearPolicies() {
+    m_policies.Clear();
+    m_prefixLengths = 0;
+}
+
+uint32_t BlackholeAodv::GetNPolicies() const {
+    return m_policies.GetSize();
+}
+
+bool BlackholeAodv::LoadPolicyFile(const std::string &fileName) {
+    std::ifstream file(fileName);
+    if (!file) {
+        NS_LOG_WARN("BlackholeAodv: Cannot open policy file " << fileName);
+        return false;
+    }
+    bool ok = true;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (BlackholeReadConfigLine(file, line, lineNumber)) {
+        std::istringstream fields(line);
+        std::string kind;
+        fields >> kind;
+        bool added = false;
+        double probability;
+        if (kind == "flow") {
+            std::string source, destination;
+            uint32_t protocol, port;
+            if (fields >> source >> destination >> protocol >> port >> probability &&
+                protocol <= 255 && port <= 65535) {
+                added = AddFlowPolicy(Ipv4Address(source.c_str()), Ipv4Address(destination.c_str()),
+                                      protocol, port, probability);
+            }
+        } else if (kind == "source") {
+            std::string source;
+            if (fields >> source >> probability) {
+                added = AddSourcePolicy(Ipv4Address(source.c_str()), probability);
+            }
+        } else if (kind == "destination") {
+            std::string prefix;
+            std::string::size_type slash;
+            if (fields >> prefix >> probability && (slash = prefix.find('/')) != std::string::npos) {
+                std::istringstream lengthField(prefix.substr(slash + 1));
+                uint32_t length;
+                if (lengthField >> length && length <= 32) {
+                    added = AddDestinationPolicy(Ipv4Address(prefix.substr(0, slash).c_str()),
+                                                 Ipv4Mask(PrefixMask(length)), probability);
+                }
+            }
+        }
+        if (!added) {
+            NS_LOG_WARN("BlackholeAodv: Skipping malformed rule at " << fileName << ":" << lineNumber);
+            ok = false;
+        }
+    }
+    NS_LOG_INFO("BlackholeAodv: " << m_policies.GetSize() << " policy rules after loading " << fileName);
+    return ok;
+}
+
+void BlackholeAodv::SetPolicyFile(std::string fileName) {
+    m_policyFile = fileName;
+    if (!fileName.empty()) {
+        LoadPolicyFile(fileName);
+    }
+}
+
+std::string BlackholeAodv::GetPolicyFile() const {
+    return m_policyFile;
+}
+
+bool BlackholeAodv::HandleRequest(Ptr<const Packet> packet, const Ipv4Header &header,
+                                  Ptr<const NetDevice> idev) {
+    uint8_t rreq[RREQ_DATAGRAM_SIZE];
+    packet->CopyData(rreq, sizeof(rreq));
+    if (rreq[8] != aodv::AODVTYPE_RREQ) {
+        return false;
+    }
+    // RREQ body: flags, reserved, hop count, id, dst, dst seqno, origin, origin seqno
+    const uint8_t *body = rreq + 9;
+    uint32_t destination = ReadU32(body + 7);
+    uint32_t origin = ReadU32(body + 15);
+    // Only the first copy of a flooded request is answered or rushed; AODV
+    // discards the later ones itself
+    if (m_seenRequests.GetSize() >= MAX_SEEN_REQUESTS) {
+        m_seenRequests.Clear();
+    }
+    uint8_t &seen = m_seenRequests.Insert(MakeFlowKey(SEEN_REQUEST, origin, ReadU32(body + 3), 0, 0));
+    if (seen) {
+        return false;
+    }
+    seen = 1;
+    m_rreqsSeen++;
+    int32_t interface = m_ipv4->GetInterfaceForDevice(idev);
+    if (interface < 0 || !IsActive() || m_ipv4->GetInterfaceForAddress(Ipv4Address(origin)) >= 0 ||
+        m_ipv4->GetInterfaceForAddress(Ipv4Address(destination)) >= 0) {
+        return false; // Our own request, or one AODV answers for real
+    }
+    // Colluders never attack each other
+    if (m_collude && BlackholeCollusionRegistry::IsMemberAddress(Ipv4Address(origin))) {
+        return false;
+    }
+    if (m_forgeRreps) {
+        ForgeReply(interface, header.GetSource(), rreq);
+    }
+    if (m_wormholePeer && header.GetTtl() > 1) {
+        TunnelRequest(interface, header, rreq);
+    }
+    if (m_rushRreqs && header.GetTtl() > 1) {
+        RushRequest(interface, header.GetTtl() - 1, rreq);
+        return true;
+    }
+    return false;
+}
+
+void BlackholeAodv::ForgeReply(uint32_t interface, Ipv4Address previousHop, const uint8_t *rreq) {
+    const uint8_t *body = rreq + 9;
+    uint32_t destination = ReadU32(body + 7);
+    uint32_t origin = ReadU32(body + 15);
+    // The first colluder to answer captures the flow for the lifetime of
+    // its forged route; the others stay quiet instead of racing it
+    if (m_collude && !BlackholeCollusionRegistry::MarkCaptured(Ipv4Address(origin), Ipv4Address(destination),
+                                                               m_nodeId, Simulator::Now() + m_forgedLifetime)) {
+        m_rrepsYielded++;
+        return;
+    }
+    bool unknownSeqNo = body[0] & 0x08;
+    uint32_t seqNo = (unknownSeqNo ? 0 : ReadU32(body + 11)) + m_seqNoBoost;
+
+    // Patch the per-request fields of the pre-serialized RREP
+    uint8_t *rrep = m_rrepTemplate + 9;
+    WriteU32(rrep + 3, destination);
+    WriteU32(rrep + 7, seqNo);
+    WriteU32(rrep + 11, origin);
+
+    // Send straight down through Ipv4 on the interface the RREQ came in on
+    Ptr<Ipv4Route> route = GetSendRoute(interface, previousHop);
+    m_ipv4->Send(Create<Packet>(m_rrepTemplate, RREP_DATAGRAM_SIZE), route->GetSource(), previousHop,
+                 17, route);
+    m_rrepsForged++;
+    int64_t &expires = m_forgedRoutes.Insert(MakeFlowKey(FORGED_ROUTE, 0, destination, 0, 0));
+    expires = std::max(expires, (Simulator::Now() + m_forgedLifetime).GetTimeStep());
+}
+
+bool BlackholeAodv::IsForgedDestination(Ipv4Address destination) {
+    const int64_t *expires = m_forgedRoutes.Find(MakeFlowKey(FORGED_ROUTE, 0, destination.Get(), 0, 0));
+    return expires && Simulator::Now().GetTimeStep() < *expires;
+}
+
+void BlackholeAodv::RushRequest(uint32_t interface, uint8_t ttl, uint8_t *rreq) {
+    // The datagram copied for classification is rebroadcast as is, with
+    // the hop count bumped the way AODV would
+    uint8_t *body = rreq + 9;
+    body[2]++;
+    BroadcastRequest(interface, ttl, rreq);
+    m_rreqsRushed++;
+    m_rushedRequests.Insert(MakeFlowKey(RUSHED_REQUEST, ReadU32(body + 15), ReadU32(body + 7), 0, 0)) =
+        RUSH_PENDING;
+}
+
+void BlackholeAodv::BroadcastRequest(uint32_t interface, uint8_t ttl, const uint8_t *rreq) {
+    Ptr<Packet> request = Create<Packet>(rreq, RREQ_DATAGRAM_SIZE);
+    // Keeps the TTL of AODV's expanding ring search
+    SocketIpTtlTag ttlTag;
+    ttlTag.SetTtl(ttl);
+    request->AddPacketTag(ttlTag);
+    Ipv4Address broadcast = m_ipv4->GetAddress(interface, 0).GetBroadcast();
+    Ptr<Ipv4Route> route = GetSendRoute(interface, broadcast);
+    m_ipv4->Send(request, route->GetSource(), broadcast, 17, route);
+}
+
+void BlackholeAodv::ObserveReply(Ptr<const Packet> packet, const Ipv4Header &header) {
+    uint8_t rrep[RREP_DATAGRAM_SIZE];
+    packet->CopyData(rrep, sizeof(rrep));
+    if (rrep[8] != aodv::AODVTYPE_RREP) {
+        return;
+    }
+    // RREP body: flags, prefix size, hop count, dst, dst seqno, origin, lifetime
+    const uint8_t *body = rrep + 9;
+    uint32_t destination = ReadU32(body + 3);
+    uint32_t origin = ReadU32(body + 11);
+    if (destination == origin) {
+        // A HELLO; its sender is a neighbour our spoofed HELLOs reach, and
+        // AODV drops routes through it when its HELLOs stop
+        m_neighborsHeard.Insert(MakeFlowKey(HEARD_NEIGHBOR, header.GetSource().Get(), 0, 0, 0)) =
+            Simulator::Now().GetTimeStep();
+        return;
+    }
+    // A reply to a request the peer sent us reaches this end, which has no
+    // route back to the originator; the peer has
+    if (m_wormholePeer && m_wormholeReplies.Find(MakeFlowKey(WORMHOLE_REPLY, origin, destination, 0, 0)) &&
+        m_ipv4->GetInterfaceForAddress(header.GetDestination()) >= 0) {
+        Tunnel(Create<Packet>(rrep, RREP_DATAGRAM_SIZE), header, TUNNEL_REPLY);
+    }
+    if (!m_rushRreqs) {
+        return;
+    }
+    uint8_t *state = m_rushedRequests.Find(MakeFlowKey(RUSHED_REQUEST, origin, destination, 0, 0));
+    if (state && *state == RUSH_PENDING) {
+        *state = RUSH_WON;
+        m_rushesWon++;
+    }
+}
+
+void BlackholeAodv::AddSpoofedIdentity(Ipv4Address identity) {
+    if (m_spoofedHellos.size() >= m_maxSpoofedIdentities) {
+        NS_LOG_WARN("BlackholeAodv: MaxSpoofedIdentities reached, not spoofing " << identity);
+        return;
+    }
+    m_spoofedIdentities.push_back(identity);
+    m_spoofedHellos.push_back(BuildSpoofedHello(identity));
+    // Traffic drawn to the identity is captured until it is cleared
+    m_forgedRoutes.Insert(MakeFlowKey(FORGED_ROUTE, 0, identity.Get(), 0, 0)) =
+        std::numeric_limits<int64_t>::max();
+    if (!m_helloEvent.IsPending()) {
+        m_helloEvent = Simulator::Schedule(m_spoofedHelloInterval, &BlackholeAodv::SendSpoofedHellos, this);
+    }
+}
+
+void BlackholeAodv::ClearSpoofedIdentities() {
+    for (Ipv4Address identity : m_spoofedIdentities) {
+        m_forgedRoutes.Insert(MakeFlowKey(FORGED_ROUTE, 0, identity.Get(), 0, 0)) = 0;
+    }
+    m_spoofedIdentities.clear();
+    m_spoofedHellos.clear();
+    m_helloEvent.Cancel();
+}
+
+uint32_t BlackholeAodv::GetNSpoofedIdentities() const {
+    return m_spoofedHellos.size();
+}
+
+uint64_t BlackholeAodv::GetSpoofedHellosSent() const {
+    return m_spoofedHellosSent;
+}
+
+uint32_t BlackholeAodv::GetNNeighborsHeard() const {
+    return m_neighborsHeard.GetSize();
+}
+
+uint64_t BlackholeAodv::GetPollutedEntries() const {
+    return m_pollutedEntries.GetSize();
+}
+
+uint64_t BlackholeAodv::GetSpoofedArpReplies() const {
+    return m_spoofedArpReplies;
+}
+
+void BlackholeAodv::NotifyTxError(WifiMacDropReason reason, Ptr<const WifiMpdu> mpdu) {
+    InvalidateRouteCache();
+}
+
+void BlackholeAodv::ReceiveArp(Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol,
+                               const Address &from, const Address &to, NetDevice::PacketType packetType) {
+    if (m_spoofedIdentities.empty()) {
+        return;
     }
+    ArpHeader request;
+    if (packet->PeekHeader(request) == 0 || !request.IsRequest()) {
+        return;
+    }
+    Ipv4Address identity = request.GetDestinationIpv4Address();
+    if (std::find(m_spoofedIdentities.begin(), m_spoofedIdentities.end(), identity) ==
+            m_spoofedIdentities.end() ||
+        !IsActive()) {
+        return;
+    }
+    // The requester is about to send through the identity
+    m_pollutedEntries.Insert(MakeFlowKey(POLLUTED_ENTRY, request.GetSourceIpv4Address().Get(), identity.Get(), 0, 0)) =
+        1;
+    // The identity's own reply, if it is in range, races this one
+    ArpHeader reply;
+    reply.SetReply(device->GetAddress(), identity, request.GetSourceHardwareAddress(),
+                   request.GetSourceIpv4Address());
+    Ptr<Packet> answer = Create<Packet>();
+    answer->AddHeader(reply);
+    device->Send(answer, request.GetSourceHardwareAddress(), ArpL3Protocol::PROT_NUMBER);
+    m_spoofedArpReplies++;
+}
+
+Ptr<Packet> BlackholeAodv::BuildSpoofedHello(Ipv4Address identity) const {
+    // A HELLO is an RREP with destination == originator == the sender and
+    // hop count 0; receivers install a neighbour route to the destination.
+    // The lifetime covers AODV's default AllowedHelloLoss of two intervals.
+    uint8_t hello[RREP_DATAGRAM_SIZE];
+    WriteU16(hello, aodv::RoutingProtocol::AODV_PORT);
+    WriteU16(hello + 2, aodv::RoutingProtocol::AODV_PORT);
+    WriteU16(hello + 4, RREP_DATAGRAM_SIZE);
+    WriteU16(hello + 6, 0);
+    hello[8] = aodv::AODVTYPE_RREP;
+    uint8_t *body = hello + 9;
+    body[0] = 0;
+    body[1] = 0;
+    body[2] = 0;
+    WriteU32(body + 3, identity.Get());
+    WriteU32(body + 7, m_seqNoBoost);
+    WriteU32(body + 11, identity.Get());
+    WriteU32(body + 15, static_cast<uint32_t>(2 * m_spoofedHelloInterval.GetMilliSeconds()));
+    return Create<Packet>(hello, RREP_DATAGRAM_SIZE);
+}
+
+void BlackholeAodv::SendSpoofedHellos() {
+    m_helloEvent = Simulator::Schedule(m_spoofedHelloInterval, &BlackholeAodv::SendSpoofedHellos, this);
+    if (!IsActive()) {
+        return;
+    }
+    SocketIpTtlTag ttlTag;
+    ttlTag.SetTtl(1);
+    for (uint32_t interface = 1; interface < m_ipv4->GetNInterfaces(); ++interface) {
+        if (!m_ipv4->IsUp(interface)) {
+            continue;
+        }
+        Ipv4Address broadcast = m_ipv4->GetAddress(interface, 0).GetBroadcast();
+        Ptr<Ipv4Route> route = GetSendRoute(interface, broadcast);
+        for (const Ptr<Packet> &hello : m_spoofedHellos) {
+            // Copies share the prebuilt buffer
+            Ptr<Packet> copy = hello->Copy();
+            copy->AddPacketTag(ttlTag);
+            m_ipv4->Send(copy, route->GetSource(), broadcast, 17, route);
+        }
+        m_spoofedHellosSent += m_spoofedHellos.size();
+    }
+}
+
+Ptr<Ipv4Route> BlackholeAodv::GetSendRoute(uint32_t interface, Ipv4Address gateway) {
+    if (interface >= m_replyRoutes.size()) {
+        m_replyRoutes.resize(interface + 1);
+    }
+    Ptr<Ipv4Route> &route = m_replyRoutes[interface];
+    if (!route) {
+        route = Create<Ipv4Route>();
+        route->SetSource(m_ipv4->GetAddress(interface, 0).GetLocal());
+        route->SetOutputDevice(m_ipv4->GetNetDevice(interface));
+    }
+    route->SetDestination(gateway);
+    route->SetGateway(gateway);
+    return route;
+}
+
+void BlackholeAodv::BuildRrepTemplate() {
+    // UDP header; the checksum is left zero, as ns-3 does unless
+    // checksums are enabled globally
+    WriteU16(m_rrepTemplate, aodv::RoutingProtocol::AODV_PORT);
+    WriteU16(m_rrepTemplate + 2, aodv::RoutingProtocol::AODV_PORT);
+    WriteU16(m_rrepTemplate + 4, RREP_DATAGRAM_SIZE);
+    WriteU16(m_rrepTemplate + 6, 0);
+    m_rrepTemplate[8] = aodv::AODVTYPE_RREP;
+    // RREP body: flags, prefix size, hop count, dst, dst seqno, origin, lifetime (ms)
+    uint8_t *rrep = m_rrepTemplate + 9;
+    rrep[0] = 0;
+    rrep[1] = 0;
+    rrep[2] = m_forgedHopCount;
+    WriteU32(rrep + 3, 0);
+    WriteU32(rrep + 7, 0);
+    WriteU32(rrep + 11, 0);
+    WriteU32(rrep + 15, static_cast<uint32_t>(m_forgedLifetime.GetMilliSeconds()));
+}
+
+void BlackholeAodv::SetForgedHopCount(uint8_t hopCount) {
+    m_forgedHopCount = hopCount;
+    BuildRrepTemplate();
+}
+
+uint8_t BlackholeAodv::GetForgedHopCount() const {
+    return m_forgedHopCount;
+}
+
+void BlackholeAodv::SetForgedLifetime(Time lifetime) {
+    m_forgedLifetime = lifetime;
+    BuildRrepTemplate();
+}
+
+Time BlackholeAodv::GetForgedLifetime() const {
+    return m_forgedLifetime;
+}
+
+uint64_t BlackholeAodv::GetRreqsSeen() const {
+    return m_rreqsSeen;
+}
+
+uint64_t BlackholeAodv::GetRrepsForged() const {
+    return m_rrepsForged;
+}
+
+uint64_t BlackholeAodv::GetRrepsYielded() const {
+    return m_rrepsYielded;
+}
+
+uint64_t BlackholeAodv::GetRreqsRushed() const {
+    return m_rreqsRushed;
+}
 
-    totalForwardedPackets++;
-    NS_LOG_INFO("BlackholeAodv: Forwarded packet from " << header.GetSource() 
-                << " to " << header.GetDestination());
-    return true; // Forward the packet
+uint64_t BlackholeAodv::GetRushesWon() const {
+    return m_rushesWon;
+}
+
+void BlackholeAodv::LinkWormhole(Ptr<BlackholeAodv> first, Ptr<BlackholeAodv> second) {
+    NS_ASSERT(first != second);
+    first->m_wormholePeer = second;
+    second->m_wormholePeer = first;
+}
+
+Ptr<BlackholeAodv> BlackholeAodv::GetWormholePeer() const {
+    return m_wormholePeer;
+}
+
+bool BlackholeAodv::Tunnel(Ptr<const Packet> packet, const Ipv4Header &header, TunnelPayload payload) {
+    if (m_tunnelInFlight >= m_tunnelQueueLimit) {
+        m_tunnelDrops++;
+        return false;
+    }
+    // The packet is held by reference; nothing is copied until it leaves
+    Time now = Simulator::Now();
+    Time departure = std::max(now, m_tunnelBusyUntil);
+    if (m_tunnelDataRate.GetBitRate() != 0) {
+        departure += m_tunnelDataRate.CalculateBytesTxTime(packet->GetSize() + header.GetSerializedSize());
+    }
+    m_tunnelBusyUntil = departure;
+    m_tunnelInFlight++;
+    Simulator::Schedule(departure + m_tunnelDelay - now, &BlackholeAodv::TunnelArrival, this, packet, header, now,
+                        payload);
+    return true;
+}
+
+void BlackholeAodv::TunnelArrival(Ptr<const Packet> packet, Ipv4Header header, Time captured,
+                                  TunnelPayload payload) {
+    m_tunnelInFlight--;
+    if (!m_wormholePeer) {
+        return; // Unlinked while the packet was in flight
+    }
+    if (payload == TUNNEL_REQUEST) {
+        m_tunnelledControl++;
+        m_wormholePeer->TunnelRequestExit(packet, header);
+        return;
+    }
+    if (payload == TUNNEL_REPLY) {
+        m_tunnelledControl++;
+        m_wormholePeer->TunnelReplyExit(packet);
+        return;
+    }
+    Time latency = Simulator::Now() - captured;
+    m_tunnelledPackets++;
+    m_tunnelledBytes += packet->GetSize() + header.GetSerializedSize();
+    m_tunnelLatencySum += latency;
+    m_tunnelMaxLatency = std::max(m_tunnelMaxLatency, latency);
+    m_wormholePeer->TunnelExit(packet, header);
+}
+
+void BlackholeAodv::TunnelExit(Ptr<const Packet> packet, const Ipv4Header &header) {
+    // Without a route AODV returns the loopback route; the tagged copy
+    // sent over it is queued while AODV discovers a route
+    Ptr<Packet> copy = packet->Copy();
+    Socket::SocketErrno sockerr = Socket::ERROR_NOTERROR;
+    Ptr<Ipv4Route> route = m_aodv->RouteOutput(copy, header, nullptr, sockerr);
+    if (!route || sockerr != Socket::ERROR_NOTERROR) {
+        m_tunnelExitDrops++;
+        return;
+    }
+    m_ipv4->SendWithHeader(copy, header, route);
+}
+
+void BlackholeAodv::TunnelRequest(uint32_t interface, const Ipv4Header &header, const uint8_t *rreq) {
+    const uint8_t *body = rreq + 9;
+    if (m_wormholeRequests.GetSize() >= MAX_SEEN_REQUESTS) {
+        m_wormholeRequests.Clear();
+    }
+    WormholeRequest &request =
+        m_wormholeRequests.Insert(MakeFlowKey(WORMHOLE_REQUEST, ReadU32(body + 15), ReadU32(body + 7), 0, 0));
+    request.previousHop = header.GetSource().Get();
+    request.interface = interface;
+    Tunnel(Create<Packet>(rreq, RREQ_DATAGRAM_SIZE), header, TUNNEL_REQUEST);
+}
+
+void BlackholeAodv::TunnelRequestExit(Ptr<const Packet> packet, const Ipv4Header &header) {
+    uint8_t rreq[RREQ_DATAGRAM_SIZE];
+    packet->CopyData(rreq, sizeof(rreq));
+    uint8_t *body = rreq + 9;
+    uint32_t destination = ReadU32(body + 7);
+    uint32_t origin = ReadU32(body + 15);
+    if (m_ipv4->GetInterfaceForAddress(Ipv4Address(destination)) >= 0) {
+        return; // Only AODV can answer for our own address
+    }
+    // The flood coming back from our neighbours is not sent back in
+    if (m_seenRequests.GetSize() >= MAX_SEEN_REQUESTS) {
+        m_seenRequests.Clear();
+    }
+    m_seenRequests.Insert(MakeFlowKey(SEEN_REQUEST, origin, ReadU32(body + 3), 0, 0)) = 1;
+    if (m_wormholeReplies.GetSize() >= MAX_SEEN_REQUESTS) {
+        m_wormholeReplies.Clear();
+    }
+    m_wormholeReplies.Insert(MakeFlowKey(WORMHOLE_REPLY, origin, destination, 0, 0)) = 1;
+    // The tunnel counts as one hop
+    body[2]++;
+    for (uint32_t interface = 0; interface < m_ipv4->GetNInterfaces(); ++interface) {
+        if (m_ipv4->GetNetDevice(interface) != m_loopback && m_ipv4->IsUp(interface)) {
+            BroadcastRequest(interface, header.GetTtl() - 1, rreq);
+        }
+    }
+}
+
+void BlackholeAodv::TunnelReplyExit(Ptr<const Packet> packet) {
+    uint8_t rrep[RREP_DATAGRAM_SIZE];
+    packet->CopyData(rrep, sizeof(rrep));
+    uint8_t *body = rrep + 9;
+    uint32_t destination = ReadU32(body + 3);
+    const WormholeRequest *request =
+        m_wormholeRequests.Find(MakeFlowKey(WORMHOLE_REQUEST, ReadU32(body + 11), destination, 0, 0));
+    if (!request) {
+        return; // Forgotten since the request went in
+    }
+    body[2]++;
+    Ipv4Address previousHop(request->previousHop);
+    Ptr<Ipv4Route> route = GetSendRoute(request->interface, previousHop);
+    m_ipv4->Send(Create<Packet>(rrep, RREP_DATAGRAM_SIZE), route->GetSource(), previousHop, 17, route);
+    // Data for the destination now comes to this end, which has no route
+    // to it; it is handled like data to a forged destination
+    int64_t expires = (Simulator::Now() + MilliSeconds(ReadU32(body + 15))).GetTimeStep();
+    int64_t &forged = m_forgedRoutes.Insert(MakeFlowKey(FORGED_ROUTE, 0, destination, 0, 0));
+    forged = std::max(forged, expires);
+}
+
+uint64_t BlackholeAodv::GetTunnelledPackets() const {
+    return m_tunnelledPackets;
+}
+
+uint64_t BlackholeAodv::GetTunnelledBytes() const {
+    return m_tunnelledBytes;
+}
+
+uint64_t BlackholeAodv::GetTunnelDrops() const {
+    return m_tunnelDrops;
+}
+
+uint64_t BlackholeAodv::GetTunnelExitDrops() const {
+    return m_tunnelExitDrops;
+}
+
+uint64_t BlackholeAodv::GetTunnelledControl() const {
+    return m_tunnelledControl;
+}
+
+Time BlackholeAodv::GetTunnelMeanLatency() const {
+    if (m_tunnelledPackets == 0) {
+        return Seconds(0);
+    }
+    return TimeStep(m_tunnelLatencySum.GetTimeStep() / static_cast<int64_t>(m_tunnelledPackets));
+}
+
+Time BlackholeAodv::GetTunnelMaxLatency() const {
+    return m_tunnelMaxLatency;
+}
+
+void BlackholeAodv::DelayPacket(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header) {
+    uint32_t entry = m_delayFree;
+    if (entry != WHEEL_NONE) {
+        m_delayFree = m_delayPool[entry].next;
+    } else if (m_delayPool.size() < m_maxDelayedPackets) {
+        entry = m_delayPool.size();
+        m_delayPool.push_back(DelayedPacket());
+    } else {
+        m_delayOverflows++;
+        (*m_currentUcb)(route, packet, header);
+        return;
+    }
+    if (m_delayUcb.IsNull()) {
+        m_delayUcb = *m_currentUcb;
+    }
+
+    int64_t tickSteps = std::max<int64_t>(m_delayTick.GetTimeStep(), 1);
+    int64_t nowTick = Simulator::Now().GetTimeStep() / tickSteps;
+    if (m_wheel0Count + m_wheel1Count == 0) {
+        m_wheelNow = nowTick;
+    }
+    int64_t delayTicks = (Seconds(m_delayVariable->GetValue()).GetTimeStep() + tickSteps - 1) / tickSteps;
+    // Level 1 must not wrap onto the epoch being processed
+    delayTicks = std::min<int64_t>(std::max<int64_t>(delayTicks, 1), (WHEEL1_SLOTS - 2) * WHEEL0_SLOTS);
+
+    DelayedPacket &delayed = m_delayPool[entry];
+    delayed.route = route;
+    delayed.packet = packet;
+    delayed.header = header;
+    delayed.releaseTick = nowTick + delayTicks;
+    int64_t releaseTick = delayed.releaseTick;
+    bool level0 = InsertIntoWheel(entry);
+    m_delayedPackets++;
+
+    // Only the new entry can move the next event earlier
+    int64_t boundary = (m_wheelNow | (WHEEL0_SLOTS - 1)) + 1;
+    int64_t next = level0 ? std::min(releaseTick, boundary) : boundary;
+    if (m_wheelScheduledTick < 0 || next < m_wheelScheduledTick) {
+        ScheduleWheel(next);
+    }
+}
+
+bool BlackholeAodv::InsertIntoWheel(uint32_t entry) {
+    DelayedPacket &delayed = m_delayPool[entry];
+    if (delayed.releaseTick - m_wheelNow < WHEEL0_SLOTS) {
+        uint32_t slot = delayed.releaseTick & (WHEEL0_SLOTS - 1);
+        delayed.next = m_wheel0[slot];
+        m_wheel0[slot] = entry;
+        m_wheel0Occupied[slot >> 6] |= 1ull << (slot & 63);
+        m_wheel0Count++;
+        return true;
+    }
+    uint32_t slot = (delayed.releaseTick / WHEEL0_SLOTS) & (WHEEL1_SLOTS - 1);
+    delayed.next = m_wheel1[slot];
+    m_wheel1[slot] = entry;
+    m_wheel1Count++;
+    return false;
+}
+
+int64_t BlackholeAodv::NextWheelTick() const {
+    if (m_wheel0Count + m_wheel1Count == 0) {
+        return -1;
+    }
+    // Every epoch boundary is visited while anything is pending, so level 0
+    // never lags behind the clock by more than one epoch
+    int64_t boundary = (m_wheelNow | (WHEEL0_SLOTS - 1)) + 1;
+    for (int64_t tick = m_wheelNow + 1; tick < boundary && m_wheel0Count > 0; ++tick) {
+        uint32_t slot = tick & (WHEEL0_SLOTS - 1);
+        if (m_wheel0Occupied[slot >> 6] & (1ull << (slot & 63))) {
+            return tick;
+        }
+    }
+    return boundary;
+}
+
+void BlackholeAodv::ScheduleWheel(int64_t tick) {
+    int64_t tickSteps = std::max<int64_t>(m_delayTick.GetTimeStep(), 1);
+    m_wheelEvent.Cancel();
+    m_wheelScheduledTick = tick;
+    m_wheelEvent = Simulator::Schedule(TimeStep(tick * tickSteps) - Simulator::Now(),
+                                       &BlackholeAodv::ProcessWheel, this);
+}
+
+void BlackholeAodv::ProcessWheel() {
+    m_wheelNow = m_wheelScheduledTick;
+    m_wheelScheduledTick = -1;
+
+    // Cascade the level-1 slot of the epoch that starts now
+    if ((m_wheelNow & (WHEEL0_SLOTS - 1)) == 0 && m_wheel1Count > 0) {
+        uint32_t slot = (m_wheelNow / WHEEL0_SLOTS) & (WHEEL1_SLOTS - 1);
+        uint32_t entry = m_wheel1[slot];
+        m_wheel1[slot] = WHEEL_NONE;
+        while (entry != WHEEL_NONE) {
+            uint32_t next = m_delayPool[entry].next;
+            m_wheel1Count--;
+            InsertIntoWheel(entry);
+            entry = next;
+        }
+    }
+
+    uint32_t slot = m_wheelNow & (WHEEL0_SLOTS - 1);
+    uint32_t entry = m_wheel0[slot];
+    m_wheel0[slot] = WHEEL_NONE;
+    m_wheel0Occupied[slot >> 6] &= ~(1ull << (slot & 63));
+    while (entry != WHEEL_NONE) {
+        DelayedPacket &delayed = m_delayPool[entry];
+        uint32_t next = delayed.next;
+        Ptr<Ipv4Route> route = delayed.route;
+        Ptr<const Packet> packet = delayed.packet;
+        Ipv4Header header = delayed.header;
+        delayed.route = nullptr;
+        delayed.packet = nullptr;
+        delayed.next = m_delayFree;
+        m_delayFree = entry;
+        m_wheel0Count--;
+        m_delayUcb(route, packet, header);
+        entry = next;
+    }
+
+    int64_t next = NextWheelTick();
+    if (next >= 0) {
+        ScheduleWheel(next);
+    }
+}
+
+void BlackholeAodv::SetDelayProbability(double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid delay probability. Retaining previous value = " << m_delayProbability);
+        return;
+    }
+    m_delayProbability = probability;
+    m_delayThreshold = ProbabilityToThreshold(probability);
+}
+
+double BlackholeAodv::GetDelayProbability() const {
+    return m_delayProbability;
+}
+
+uint64_t BlackholeAodv::GetDelayedPackets() const {
+    return m_delayedPackets;
+}
+
+uint64_t BlackholeAodv::GetDelayOverflows() const {
+    return m_delayOverflows;
+}
+
+int64_t BlackholeAodv::AssignStreams(int64_t stream) {
+    m_delayVariable->SetStream(stream);
+    return 1;
+}
+
+void BlackholeAodv::AddActiveInterval(Time start, Time stop) {
+    if (stop <= start) {
+        NS_LOG_WARN("BlackholeAodv: Ignoring empty active interval [" << start << ", " << stop << ")");
+        return;
+    }
+    ActiveInterval interval = {start.GetTimeStep(), stop.GetTimeStep()};
+    std::vector<ActiveInterval>::iterator it =
+        std::lower_bound(m_intervals.begin(), m_intervals.end(), interval,
+                         [](const ActiveInterval &a, const ActiveInterval &b) { return a.start < b.start; });
+    it = m_intervals.insert(it, interval);
+    // Merge overlapping neighbours so that the cursor only ever moves forward
+    if (it != m_intervals.begin() && (it - 1)->stop >= it->start) {
+        --it;
+        it->stop = std::max(it->stop, (it + 1)->stop);
+        m_intervals.erase(it + 1);
+    }
+    while (it + 1 != m_intervals.end() && (it + 1)->start <= it->stop) {
+        it->stop = std::max(it->stop, (it + 1)->stop);
+        m_intervals.erase(it + 1);
+    }
+    ResetSchedule();
+}
+
+void BlackholeAodv::ClearSchedule() {
+    m_intervals.clear();
+    ResetSchedule();
+}
+
+bool BlackholeAodv::LoadScheduleFile(const std::string &fileName) {
+    std::ifstream file(fileName);
+    if (!file) {
+        NS_LOG_WARN("BlackholeAodv: Cannot open schedule file " << fileName);
+        return false;
+    }
+    bool ok = true;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (BlackholeReadConfigLine(file, line, lineNumber)) {
+        std::istringstream fields(line);
+        double start, stop;
+        if (fields >> start >> stop && start < stop) {
+            AddActiveInterval(Seconds(start), Seconds(stop));
+        } else {
+            NS_LOG_WARN("BlackholeAodv: Skipping malformed interval at " << fileName << ":" << lineNumber);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void BlackholeAodv::SetScheduleFile(std::string fileName) {
+    m_scheduleFile = fileName;
+    if (!fileName.empty()) {
+        LoadScheduleFile(fileName);
+    }
+}
+
+std::string BlackholeAodv::GetScheduleFile() const {
+    return m_scheduleFile;
+}
+
+void BlackholeAodv::SetActiveStart(Time start) {
+    m_activeStart = start;
+    ResetSchedule();
+}
+
+Time BlackholeAodv::GetActiveStart() const {
+    return m_activeStart;
+}
+
+void BlackholeAodv::SetActiveOn(Time on) {
+    m_activeOn = on;
+    ResetSchedule();
+}
+
+Time BlackholeAodv::GetActiveOn() const {
+    return m_activeOn;
+}
+
+void BlackholeAodv::SetActiveOff(Time off) {
+    m_activeOff = off;
+    ResetSchedule();
+}
+
+Time BlackholeAodv::GetActiveOff() const {
+    return m_activeOff;
+}
+
+void BlackholeAodv::SetEventRingSize(uint32_t size) {
+    m_eventRing.assign(size, EventRecord());
+    m_eventRingPos = 0;
+    m_eventRingWritten = 0;
+}
+
+uint32_t BlackholeAodv::GetEventRingSize() const {
+    return m_eventRing.size();
+}
+
+void BlackholeAodv::DumpEventRing(std::ostream &os) const {
+    const uint32_t magic = 0x42485247; // "BHRG"
+    uint64_t count = std::min<uint64_t>(m_eventRingWritten, m_eventRing.size());
+    os.write(reinterpret_cast<const char *>(&magic), sizeof(magic));
+    os.write(reinterpret_cast<const char *>(&count), sizeof(count));
+    if (count == 0) {
+        return;
+    }
+    // Once the ring has wrapped the oldest record sits at the write position
+    uint32_t start = (m_eventRingWritten > m_eventRing.size()) ? m_eventRingPos : 0;
+    for (uint64_t i = 0; i < count; ++i) {
+        const EventRecord &record = m_eventRing[(start + i) % m_eventRing.size()];
+        os.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    }
 }
 
 
@@ -71,6 +1904,8 @@ void BlackholeAodv::SetDropProbability(double probability) {
         NS_LOG_WARN("BlackholeAodv: Invalid drop probability. Retaining previous value = " << dropProbability);
     } else {
         dropProbability = probability;
+        m_dropThreshold = ProbabilityToThreshold(probability);
+        ResetDecisionBlock();
         NS_LOG_INFO("BlackholeAodv: Drop probability updated to " << dropProbability);
     }
 }
@@ -79,39 +1914,475 @@ double BlackholeAodv::GetDropProbability() const {
     return dropProbability;
 }
 
-uint32_t BlackholeAodv::GetTotalDroppedPackets() const {
+void BlackholeAodv::SetGoodDropProbability(double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid good-state drop probability. Retaining previous value = " << m_goodDropProbability);
+        return;
+    }
+    m_goodDropProbability = probability;
+    UpdateBurstThresholds();
+}
+
+double BlackholeAodv::GetGoodDropProbability() const {
+    return m_goodDropProbability;
+}
+
+void BlackholeAodv::SetBadDropProbability(double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid bad-state drop probability. Retaining previous value = " << m_badDropProbability);
+        return;
+    }
+    m_badDropProbability = probability;
+    UpdateBurstThresholds();
+}
+
+double BlackholeAodv::GetBadDropProbability() const {
+    return m_badDropProbability;
+}
+
+void BlackholeAodv::SetGoodToBadProbability(double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid good-to-bad probability. Retaining previous value = " << m_goodToBadProbability);
+        return;
+    }
+    m_goodToBadProbability = probability;
+    UpdateBurstThresholds();
+}
+
+double BlackholeAodv::GetGoodToBadProbability() const {
+    return m_goodToBadProbability;
+}
+
+void BlackholeAodv::SetBadToGoodProbability(double probability) {
+    if (probability < 0.0 || probability > 1.0) {
+        NS_LOG_WARN("BlackholeAodv: Invalid bad-to-good probability. Retaining previous value = " << m_badToGoodProbability);
+        return;
+    }
+    m_badToGoodProbability = probability;
+    UpdateBurstThresholds();
+}
+
+double BlackholeAodv::GetBadToGoodProbability() const {
+    return m_badToGoodProbability;
+}
+
+uint64_t BlackholeAodv::GetTotalDroppedPackets() const {
     return totalDroppedPackets;
 }
 
-uint32_t BlackholeAodv::GetTotalForwardedPackets() const {
+uint64_t BlackholeAodv::GetTotalForwardedPackets() const {
     return totalForwardedPackets;
 }
 
 void BlackholeAodv::PrintRoutingTable(Ptr<OutputStreamWrapper> stream, Time::Unit unit) const {
-    *stream->GetStream() << "BlackholeAodv: Routing table not maintained.\n";
+    std::ostream &os = *stream->GetStream();
+    // m_active is only brought up to date by IsActive(), which advances the
+    // schedule cursor; printing must not show a stale state
+    bool active = const_cast<BlackholeAodv *>(this)->IsActive();
+    os << "BlackholeAodv: drop probability " << dropProbability << (active ? ", active" : ", inactive") << "\n";
+    if (m_forgeRreps) {
+        os << "Forged RREPs: hop count " << static_cast<uint32_t>(m_forgedHopCount) << ", seqno +" << m_seqNoBoost
+           << ", lifetime " << m_forgedLifetime.As(unit) << "; " << m_rrepsForged << " sent for " << m_rreqsSeen
+           << " RREQs\n";
+    }
+    // Rows do not start with an address, so routing table diffs skip them
+    int64_t now = Simulator::Now().GetTimeStep();
+    m_forgedRoutes.ForEach([&os, now, unit](const BlackholeFlowKey &key, int64_t expires) {
+        if (expires <= now) {
+            return;
+        }
+        os << "Forged route to " << Ipv4Address(static_cast<uint32_t>(key.addresses)) << ", expires ";
+        if (expires == std::numeric_limits<int64_t>::max()) {
+            os << "never\n";
+        } else {
+            os << "at " << TimeStep(expires).As(unit) << "\n";
+        }
+    });
+    if (m_rushedRequests.GetSize() != 0) {
+        m_rushedRequests.ForEach([&os](const BlackholeFlowKey &key, uint8_t state) {
+            os << "Rushed request " << Ipv4Address(static_cast<uint32_t>(key.addresses >> 32)) << " -> "
+               << Ipv4Address(static_cast<uint32_t>(key.addresses)) << ": "
+               << (state == RUSH_WON ? "won" : "pending") << "\n";
+        });
+    }
+    if (!m_spoofedIdentities.empty()) {
+        os << "Spoofed neighbours:";
+        for (Ipv4Address identity : m_spoofedIdentities) {
+            os << " " << identity;
+        }
+        os << "\n";
+    }
+    if (m_wormholePeer && m_wormholePeer->m_ipv4) {
+        os << "Wormhole to node " << m_wormholePeer->m_ipv4->GetObject<Node>()->GetId() << "\n";
+    }
+    os << "Wrapped AODV table follows.\n";
+    m_aodv->PrintRoutingTable(stream, unit);
 }
 
 void BlackholeAodv::NotifyInterfaceUp(uint32_t interface) {
     NS_LOG_INFO("BlackholeAodv: Interface " << interface << " is up.");
+    Ptr<NetDevice> device = m_ipv4->GetNetDevice(interface);
+    if (device != m_loopback &&
+        std::find(m_arpDevices.begin(), m_arpDevices.end(), device) == m_arpDevices.end()) {
+        m_ipv4->GetObject<Node>()->RegisterProtocolHandler(MakeCallback(&BlackholeAodv::ReceiveArp, this),
+                                                           ArpL3Protocol::PROT_NUMBER, device);
+        // The same link layer feedback AODV subscribes to for this device
+        Ptr<WifiNetDevice> wifi = device->GetObject<WifiNetDevice>();
+        if (wifi && wifi->GetMac()) {
+            wifi->GetMac()->TraceConnectWithoutContext("DroppedMpdu",
+                                                       MakeCallback(&BlackholeAodv::NotifyTxError, this));
+        }
+        m_arpDevices.push_back(device);
+    }
+    RefreshLocalAddresses();
+    InvalidateRouteCache();
+    m_aodv->NotifyInterfaceUp(interface);
 }
 
 void BlackholeAodv::NotifyInterfaceDown(uint32_t interface) {
     NS_LOG_INFO("BlackholeAodv: Interface " << interface << " is down.");
+    RefreshLocalAddresses();
+    InvalidateRouteCache();
+    m_aodv->NotifyInterfaceDown(interface);
 }
 
 void BlackholeAodv::NotifyAddAddress(uint32_t interface, Ipv4InterfaceAddress address) {
     NS_LOG_INFO("BlackholeAodv: Address added to interface " << interface 
                 << ": " << address);
+    if (m_collude && m_ipv4 && interface != 0) {
+        Ptr<Node> node = m_ipv4->GetObject<Node>();
+        if (node) {
+            BlackholeCollusionRegistry::AddAddress(address.GetLocal(), node->GetId());
+        }
+    }
+    RefreshLocalAddresses();
+    InvalidateRouteCache();
+    m_aodv->NotifyAddAddress(interface, address);
 }
 
 void BlackholeAodv::NotifyRemoveAddress(uint32_t interface, Ipv4InterfaceAddress address) {
     NS_LOG_INFO("BlackholeAodv: Address removed from interface " << interface 
                 << ": " << address);
+    if (m_collude && interface != 0) {
+        BlackholeCollusionRegistry::RemoveAddress(address.GetLocal());
+    }
+    RefreshLocalAddresses();
+    InvalidateRouteCache();
+    m_aodv->NotifyRemoveAddress(interface, address);
+}
+
+void BlackholeAodv::RefreshLocalAddresses() {
+    m_localAddresses.clear();
+    m_broadcastAddresses.clear();
+    if (!m_ipv4) {
+        return;
+    }
+    for (uint32_t interface = 0; interface < m_ipv4->GetNInterfaces(); ++interface) {
+        if (!m_ipv4->IsUp(interface)) {
+            continue;
+        }
+        for (uint32_t i = 0; i < m_ipv4->GetNAddresses(interface); ++i) {
+            Ipv4InterfaceAddress address = m_ipv4->GetAddress(interface, i);
+            m_localAddresses.push_back(address.GetLocal().Get());
+            m_broadcastAddresses.push_back(address.GetBroadcast().Get());
+        }
+    }
+    std::sort(m_localAddresses.begin(), m_localAddresses.end());
+    std::sort(m_broadcastAddresses.begin(), m_broadcastAddresses.end());
+}
+
+bool BlackholeAodv::IsLocalAddress(Ipv4Address address) const {
+    return std::binary_search(m_localAddresses.begin(), m_localAddresses.end(), address.Get());
+}
+
+bool BlackholeAodv::IsBroadcastAddress(Ipv4Address address) const {
+    return std::binary_search(m_broadcastAddresses.begin(), m_broadcastAddresses.end(), address.Get());
 }
 
 void BlackholeAodv::SetIpv4(Ptr<Ipv4> ipv4) {
     m_ipv4 = ipv4;
+    Ptr<Node> node = ipv4->GetObject<Node>();
+    if (node) {
+        m_nodeId = node->GetId();
+        m_rngKey[1] = node->GetId();
+        ResetDecisionBlock();
+        if (m_collude) {
+            BlackholeCollusionRegistry::Join(node->GetId());
+        }
+    }
+    if (!m_aodv) {
+        m_aodv = CreateObject<aodv::RoutingProtocol>();
+    }
+    // AODV opens its control sockets through the node it is aggregated to
+    if (node && !node->GetObject<aodv::RoutingProtocol>()) {
+        node->AggregateObject(m_aodv);
+    }
+    // Interface 0 is the loopback, the only interface present at this point
+    m_loopback = ipv4->GetNetDevice(0);
+    RefreshLocalAddresses();
+    m_aodv->SetIpv4(ipv4);
     NS_LOG_INFO("BlackholeAodv: IPv4 set for this protocol.");
 }
 
+template <>
+TypeId BlackholeAodvAlwaysDrop::GetTypeId(void) {
+    static TypeId tid = TypeId("ns3::BlackholeAodvAlwaysDrop")
+        .SetParent<BlackholeAodv>()
+        .AddConstructor<BlackholeAodvAlwaysDrop>();
+    return tid;
+}
+
+template <>
+TypeId BlackholeAodvBernoulli::GetTypeId(void) {
+    static TypeId tid = TypeId("ns3::BlackholeAodvBernoulli")
+        .SetParent<BlackholeAodv>()
+        .AddConstructor<BlackholeAodvBernoulli>();
+    return tid;
+}
+
+template <>
+TypeId BlackholeAodvFlowAccounting::GetTypeId(void) {
+    static TypeId tid = TypeId("ns3::BlackholeAodvFlowAccounting")
+        .SetParent<BlackholeAodv>()
+        .AddConstructor<BlackholeAodvFlowAccounting>();
+    return tid;
+}
+
+template <>
+TypeId BlackholeAodvGilbertElliott::GetTypeId(void) {
+    static TypeId tid = TypeId("ns3::BlackholeAodvGilbertElliott")
+        .SetParent<BlackholeAodv>()
+        .AddConstructor<BlackholeAodvGilbertElliott>();
+    return tid;
+}
+
+BlackholeAodvHelper::BlackholeAodvHelper() {
+    m_aodvFactory.SetTypeId(aodv::RoutingProtocol::GetTypeId());
+    m_blackholeFactory.SetTypeId(BlackholeAodv::GetTypeId());
+}
+
+BlackholeAodvHelper *BlackholeAodvHelper::Copy() const {
+    return new BlackholeAodvHelper(*this);
+}
+
+Ptr<Ipv4RoutingProtocol> BlackholeAodvHelper::Create(Ptr<Node> node) const {
+    Ptr<aodv::RoutingProtocol> aodv = m_aodvFactory.Create<aodv::RoutingProtocol>();
+    node->AggregateObject(aodv);
+    if (m_attackers.find(node->GetId()) == m_attackers.end()) {
+        return aodv;
+    }
+    Ptr<BlackholeAodv> blackhole = m_blackholeFactory.Create<BlackholeAodv>();
+    blackhole->SetAodv(aodv);
+    node->AggregateObject(blackhole);
+    return blackhole;
+}
+
+namespace {
+
+// Tables of the previous dump: per node id, destination -> entry
+struct RoutingTableDiffState {
+    Time interval;
+    Ptr<OutputStreamWrapper> stream;
+    Time::Unit unit;
+    std::vector<std::map<std::string, std::string>> tables;
+};
+
+// Time columns such as "+9.98s" change on every dump without the route
+// changing, so they are not part of an entry
+bool IsTimeToken(const std::string &token) {
+    size_t i = (token[0] == '+' || token[0] == '-') ? 1 : 0;
+    size_t digits = i;
+    while (digits < token.size() && (std::isdigit(static_cast<unsigned char>(token[digits])) || token[digits] == '.')) {
+        digits++;
+    }
+    if (digits == i || digits == token.size()) {
+        return false;
+    }
+    static const char *units[] = {"y", "d", "h", "min", "s", "ms", "us", "ns", "ps", "fs"};
+    for (const char *unit : units) {
+        if (token.compare(digits, std::string::npos, unit) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Parses printed routing table rows, keyed by their first column, keeping
+// only rows that start with an IPv4 address
+void ParseRoutingTable(const std::string &text, std::map<std::string, std::string> &table) {
+    std::istringstream lines(text);
+    std::string line;
+    while (std::getline(lines, line)) {
+        std::istringstream tokens(line);
+        std::string destination;
+        if (!(tokens >> destination) || std::count(destination.begin(), destination.end(), '.') != 3 ||
+            !std::isdigit(static_cast<unsigned char>(destination[0]))) {
+            continue;
+        }
+        std::string entry;
+        std::string token;
+        while (tokens >> token) {
+            if (!IsTimeToken(token)) {
+                entry += entry.empty() ? token : " " + token;
+            }
+        }
+        table[destination] = entry;
+    }
+}
+
+void PrintRoutingTableDiffs(std::shared_ptr<RoutingTableDiffState> state) {
+    std::ostream &os = *state->stream->GetStream();
+    double now = Simulator::Now().ToDouble(state->unit);
+    if (state->tables.size() < NodeList::GetNNodes()) {
+        state->tables.resize(NodeList::GetNNodes());
+    }
+    std::ostringstream text;
+    Ptr<OutputStreamWrapper> textStream = Create<OutputStreamWrapper>(&text);
+    std::map<std::string, std::string> current;
+    for (uint32_t i = 0; i < NodeList::GetNNodes(); ++i) {
+        Ptr<Node> node = NodeList::GetNode(i);
+        Ptr<Ipv4> ipv4 = node->GetObject<Ipv4>();
+        if (!ipv4 || !ipv4->GetRoutingProtocol()) {
+            continue;
+        }
+        text.str("");
+        ipv4->GetRoutingProtocol()->PrintRoutingTable(textStream, state->unit);
+        current.clear();
+        ParseRoutingTable(text.str(), current);
+
+        // Both maps are sorted, so one merge pass finds every change
+        std::map<std::string, std::string> &previous = state->tables[node->GetId()];
+        auto p = previous.begin();
+        auto c = current.begin();
+        while (p != previous.end() || c != current.end()) {
+            if (c == current.end() || (p != previous.end() && p->first < c->first)) {
+                os << now << "," << node->GetId() << ",-," << p->first << ",\n";
+                ++p;
+            } else if (p == previous.end() || c->first < p->first) {
+                os << now << "," << node->GetId() << ",+," << c->first << "," << c->second << "\n";
+                ++c;
+            } else {
+                if (p->second != c->second) {
+                    os << now << "," << node->GetId() << ",+," << c->first << "," << c->second << "\n";
+                }
+                ++p;
+                ++c;
+            }
+        }
+        previous.swap(current);
+    }
+    Simulator::Schedule(state->interval, &PrintRoutingTableDiffs, state);
+}
+
+} // namespace
+
+void BlackholeAodvHelper::PrintRoutingTableDiffAllEvery(Time printInterval, Ptr<OutputStreamWrapper> stream,
+                                                        Time::Unit unit) {
+    std::shared_ptr<RoutingTableDiffState> state = std::make_shared<RoutingTableDiffState>();
+    state->interval = printInterval;
+    state->stream = stream;
+    state->unit = unit;
+    *stream->GetStream() << "time,node,op,destination,entry\n";
+    Simulator::Schedule(printInterval, &PrintRoutingTableDiffs, state);
+}
+
+namespace {
+
+// One attribute change, resolved at load time
+struct Reconfiguration {
+    Time at;
+    Ptr<BlackholeAodv> attacker;
+    Ptr<const AttributeAccessor> accessor;
+    Ptr<AttributeValue> value;
+};
+
+struct ReconfigurationState {
+    std::vector<Reconfiguration> changes; // Sorted by time
+    size_t next = 0;
+};
+
+void ApplyReconfigurationBatch(std::shared_ptr<ReconfigurationState> state) {
+    std::vector<Reconfiguration> &changes = state->changes;
+    Time at = changes[state->next].at;
+    while (state->next < changes.size() && changes[state->next].at == at) {
+        const Reconfiguration &change = changes[state->next++];
+        change.accessor->Set(PeekPointer(change.attacker), *change.value);
+    }
+    if (state->next < changes.size()) {
+        Simulator::Schedule(changes[state->next].at - Simulator::Now(), &ApplyReconfigurationBatch, state);
+    }
+}
+
+} // namespace
+
+bool BlackholeAodvHelper::LoadReconfigurationFile(const std::string &fileName) {
+    std::ifstream file(fileName);
+    if (!file) {
+        NS_LOG_WARN("BlackholeAodvHelper: Cannot open reconfiguration file " << fileName);
+        return false;
+    }
+    std::shared_ptr<ReconfigurationState> state = std::make_shared<ReconfigurationState>();
+    bool ok = true;
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (BlackholeReadConfigLine(file, line, lineNumber)) {
+        std::istringstream fields(line);
+        double seconds;
+        uint32_t nodeId;
+        std::string name, value;
+        if (!(fields >> seconds >> nodeId >> name >> value)) {
+            NS_LOG_WARN("BlackholeAodvHelper: Skipping malformed change at " << fileName << ":" << lineNumber);
+            ok = false;
+            continue;
+        }
+        Ptr<BlackholeAodv> attacker =
+            (nodeId < NodeList::GetNNodes()) ? NodeList::GetNode(nodeId)->GetObject<BlackholeAodv>() : nullptr;
+        TypeId::AttributeInformation info;
+        Ptr<AttributeValue> parsed;
+        if (!attacker) {
+            NS_LOG_WARN("BlackholeAodvHelper: Node " << nodeId << " is not an attacker at " << fileName << ":"
+                        << lineNumber);
+        } else if (!attacker->GetInstanceTypeId().LookupAttributeByName(name, &info)) {
+            NS_LOG_WARN("BlackholeAodvHelper: Unknown attribute " << name << " at " << fileName << ":"
+                        << lineNumber);
+        } else if (!(info.flags & TypeId::ATTR_SET)) {
+            // The accessor would refuse it only when the change is applied
+            NS_LOG_WARN("BlackholeAodvHelper: Attribute " << name << " cannot be set at " << fileName << ":"
+                        << lineNumber);
+        } else if (!(parsed = info.checker->CreateValidValue(StringValue(value)))) {
+            NS_LOG_WARN("BlackholeAodvHelper: Invalid value " << value << " for " << name << " at " << fileName
+                        << ":" << lineNumber);
+        } else {
+            // Changes already due are applied right away
+            Time at = std::max(Seconds(seconds), Simulator::Now());
+            state->changes.push_back({at, attacker, info.accessor, parsed});
+            continue;
+        }
+        ok = false;
+    }
+    if (!state->changes.empty()) {
+        // Stable, so changes sharing a time keep their order in the file
+        std::stable_sort(state->changes.begin(), state->changes.end(),
+                         [](const Reconfiguration &a, const Reconfiguration &b) { return a.at < b.at; });
+        Simulator::Schedule(state->changes.front().at - Simulator::Now(), &ApplyReconfigurationBatch, state);
+    }
+    return ok;
+}
+
+void BlackholeAodvHelper::Set(std::string name, const AttributeValue &value) {
+    m_aodvFactory.Set(name, value);
+}
+
+void BlackholeAodvHelper::SetBlackhole(std::string name, const AttributeValue &value) {
+    m_blackholeFactory.Set(name, value);
+}
+
+void BlackholeAodvHelper::SetBlackholeType(std::string typeName) {
+    m_blackholeFactory.SetTypeId(typeName);
+}
+
+void BlackholeAodvHelper::AddAttacker(uint32_t nodeId) {
+    m_attackers.insert(nodeId);
+}
+
 } // namespace ns3
@@ -1,13 +1,173 @@
 #ifndef BLACKHOLE_AODV_H
 #define BLACKHOLE_AODV_H
 
+#include "aodv-routing-protocol.h"
 #include "ns3/ipv4-routing-protocol.h"
+#include "ns3/ipv4-routing-helper.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/net-device.h"
+#include "ns3/wifi-mac.h"
+#include "ns3/wifi-mpdu.h"
+#include "ns3/object-factory.h"
 #include "ns3/ptr.h"
+#include "ns3/traced-callback.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
 #include "ns3/random-variable-stream.h"
+#include "ns3/data-rate.h"
 #include <cstdint>
+#include <istream>
+#include <ostream>
+#include <set>
+#include <string>
+#include <vector>
 
 namespace ns3 {
 
+// Flow key packed into 96 bits: both addresses in one word, then the kind
+// of entry, protocol and destination port. A zero 'rest' marks an empty
+// slot, which is why every kind value is non-zero.
+struct BlackholeFlowKey {
+    uint64_t addresses; // source << 32 | destination
+    uint32_t rest;      // kind << 24 | protocol << 16 | port
+
+    bool operator==(const BlackholeFlowKey &other) const {
+        return addresses == other.addresses && rest == other.rest;
+    }
+};
+
+// Open-addressing hash table with linear probing over a power-of-two slot
+// array. Entries are never erased individually, which keeps probing
+// tombstone-free; the table doubles when it is half full.
+template <typename T>
+class BlackholeFlowTable {
+public:
+    struct Slot {
+        BlackholeFlowKey key;
+        T value;
+    };
+
+    BlackholeFlowTable() : m_size(0) {}
+
+    T *Find(const BlackholeFlowKey &key) {
+        if (m_size == 0) {
+            return nullptr;
+        }
+        uint32_t mask = m_slots.size() - 1;
+        for (uint32_t i = Hash(key) & mask;; i = (i + 1) & mask) {
+            Slot &slot = m_slots[i];
+            if (slot.key == key) {
+                return &slot.value;
+            }
+            if (slot.key.rest == 0) {
+                return nullptr;
+            }
+        }
+    }
+
+    // Returns the value for key, value-initializing it if absent
+    T &Insert(const BlackholeFlowKey &key) {
+        if ((m_size + 1) * 2 > m_slots.size()) {
+            Grow();
+        }
+        uint32_t mask = m_slots.size() - 1;
+        for (uint32_t i = Hash(key) & mask;; i = (i + 1) & mask) {
+            Slot &slot = m_slots[i];
+            if (slot.key == key) {
+                return slot.value;
+            }
+            if (slot.key.rest == 0) {
+                slot.key = key;
+                slot.value = T();
+                m_size++;
+                return slot.value;
+            }
+        }
+    }
+
+    uint32_t GetSize() const {
+        return m_size;
+    }
+
+    void Clear() {
+        m_slots.clear();
+        m_size = 0;
+    }
+
+    template <typename F>
+    void ForEach(F f) const {
+        for (const Slot &slot : m_slots) {
+            if (slot.key.rest != 0) {
+                f(slot.key, slot.value);
+            }
+        }
+    }
+
+private:
+    static uint32_t Hash(const BlackholeFlowKey &key) {
+        uint64_t h = key.addresses ^ (static_cast<uint64_t>(key.rest) * 0x9E3779B97F4A7C15ull);
+        h ^= h >> 33;
+        h *= 0xFF51AFD7ED558CCDull;
+        h ^= h >> 33;
+        return static_cast<uint32_t>(h);
+    }
+
+    void Grow() {
+        std::vector<Slot> old;
+        old.swap(m_slots);
+        m_slots.assign(old.empty() ? 16 : old.size() * 2, Slot());
+        m_size = 0;
+        for (const Slot &slot : old) {
+            if (slot.key.rest != 0) {
+                Insert(slot.key) = slot.value;
+            }
+        }
+    }
+
+    std::vector<Slot> m_slots;
+    uint32_t m_size;
+};
+
+// Simulation-wide registry shared by colluding attackers. Membership is a
+// flat array indexed by node id and captured flows are a fixed-size slot
+// array over a hash of (source, destination), each slot holding the
+// capturing node and when its forged route expires. Both checks are O(1)
+// and never allocate once the registry has been populated. A slot
+// collision can report an uncaptured flow as captured by another member;
+// with 2^16 slots this is rare for the flow counts we simulate.
+class BlackholeCollusionRegistry {
+public:
+    static void Join(uint32_t nodeId);
+    static void Leave(uint32_t nodeId);
+    static bool IsMember(uint32_t nodeId);
+    static uint32_t GetNMembers();
+
+    // Addresses of members, so packet headers can be checked directly
+    static void AddAddress(Ipv4Address address, uint32_t nodeId);
+    static void RemoveAddress(Ipv4Address address);
+    static bool IsMemberAddress(Ipv4Address address);
+
+    // Captures the flow for nodeId until expires. Returns false if another
+    // member holds it; the holder itself may capture it again, which
+    // extends the capture.
+    static bool MarkCaptured(Ipv4Address source, Ipv4Address destination, uint32_t nodeId, Time expires);
+    static bool IsCaptured(Ipv4Address source, Ipv4Address destination);
+    // Captures granted so far, not counting extensions by the holder
+    static uint32_t GetNCaptured();
+
+    // Forgets all members and captures, e.g. between runs
+    static void Clear();
+};
+
+// Reads the next line of a text configuration file into line, with any
+// '#' comment stripped; blank lines are skipped. lineNumber counts every
+// line read, for error messages. Returns false at the end of the input.
+bool BlackholeReadConfigLine(std::istream &is, std::string &line, uint32_t &lineNumber);
+
+// Decorator over aodv::RoutingProtocol. Route discovery, local delivery
+// and route output are delegated to the wrapped AODV instance; the only
+// thing the blackhole adds is a drop decision on unicast packets that AODV
+// decides to forward.
 class BlackholeAodv : public Ipv4RoutingProtocol {
 public:
     static TypeId GetTypeId(void);
@@ -15,6 +175,21 @@ public:
     BlackholeAodv();
     virtual ~BlackholeAodv();
 
+    // The AODV instance decorated by this attacker. Must be aggregated to the
+    // node (BlackholeAodvHelper does both); SetIpv4 creates one if unset.
+    void SetAodv(Ptr<aodv::RoutingProtocol> aodv);
+    Ptr<aodv::RoutingProtocol> GetAodv() const;
+
+    // Routes AODV returns for locally originated packets are cached per
+    // destination for up to RouteCacheLifetime. The whole cache is
+    // invalidated by RREPs, RERRs, MAC transmit failures (AODV's link
+    // layer feedback) and interface or address changes. An entry never
+    // outlives the AODV route, which hits do not refresh, nor the HELLO
+    // timeout of its next hop.
+    uint64_t GetRouteCacheHits() const;
+    uint64_t GetRouteCacheMisses() const;
+    void InvalidateRouteCache();
+
     // Inherited from Ipv4RoutingProtocol
     virtual Ptr<Ipv4Route> RouteOutput(Ptr<Packet> packet,
                                        const Ipv4Header &header,
@@ -39,17 +214,720 @@ public:
     void SetDropProbability(double probability);
     double GetDropProbability() const;
 
-    uint32_t GetTotalDroppedPackets() const;
+    // Model behind the global drop decision. Per-flow policy rules are
+    // always Bernoulli.
+    enum DropModel {
+        BERNOULLI,      // i.i.d. drops with DropProbability
+        GILBERT_ELLIOTT // Two-state (good/bad) Markov chain, bursty drops
+    };
+
+    // Gilbert-Elliott parameters: drop probability in each state and the
+    // per-packet state transition probabilities
+    void SetGoodDropProbability(double probability);
+    double GetGoodDropProbability() const;
+    void SetBadDropProbability(double probability);
+    double GetBadDropProbability() const;
+    void SetGoodToBadProbability(double probability);
+    double GetGoodToBadProbability() const;
+    void SetBadToGoodProbability(double probability);
+    double GetBadToGoodProbability() const;
+
+    uint64_t GetTotalDroppedPackets() const;
 
     // Declaration of GetTotalForwardedPackets
-    uint32_t GetTotalForwardedPackets() const;
+    uint64_t GetTotalForwardedPackets() const;
+
+    // 64-bit packet and byte counters kept per flow, per input interface
+    // and in total
+    struct Counters {
+        uint64_t droppedPackets;
+        uint64_t droppedBytes;
+        uint64_t forwardedPackets;
+        uint64_t forwardedBytes;
+
+        void Add(uint32_t bytes, bool dropped) {
+            if (dropped) {
+                droppedPackets++;
+                droppedBytes += bytes;
+            } else {
+                forwardedPackets++;
+                forwardedBytes += bytes;
+            }
+        }
+    };
+
+    struct FlowStats {
+        Ipv4Address source;
+        Ipv4Address destination;
+        uint8_t protocol;
+        uint16_t destinationPort;
+        Counters counters;
+    };
+
+    // Point-in-time copy of the accounting tables
+    struct AccountingSnapshot {
+        Time time;
+        Counters total;
+        Counters untrackedFlows;          // Packets of flows beyond MaxTrackedFlows
+        std::vector<FlowStats> flows;
+        std::vector<Counters> interfaces; // Indexed by Ipv4 interface
+    };
+
+    // Copies the counters into snapshot, reusing its vectors' storage so that
+    // periodic snapshots do not reallocate
+    void Snapshot(AccountingSnapshot &snapshot) const;
+
+    // Gray-hole activity schedule. While inactive the attacker forwards
+    // everything. Either a list of [start, stop) intervals or, if none were
+    // added, a periodic on/off pattern is used; with neither it is always
+    // active. Activity is evaluated lazily from Simulator::Now() with a
+    // cursor that only moves forward, so no toggling events are scheduled.
+    void AddActiveInterval(Time start, Time stop);
+    void ClearSchedule();
+    // Reads one "<start-seconds> <stop-seconds>" interval per line
+    bool LoadScheduleFile(const std::string &fileName);
+    void SetActiveStart(Time start);
+    Time GetActiveStart() const;
+    void SetActiveOn(Time on);
+    Time GetActiveOn() const;
+    void SetActiveOff(Time off);
+    Time GetActiveOff() const;
+    bool IsActive();
+
+    // Jellyfish mode: a DelayProbability fraction of the forwarded packets is
+    // held back for a DelayVariable delay (seconds) and released in tick
+    // batches, which also reorders them
+    void SetDelayProbability(double probability);
+    double GetDelayProbability() const;
+    uint64_t GetDelayedPackets() const;
+    // Packets forwarded undelayed because MaxDelayedPackets were held
+    uint64_t GetDelayOverflows() const;
+    int64_t AssignStreams(int64_t stream);
+
+    // Forged RREPs: while active, every RREQ heard is answered at once with
+    // an RREP claiming a short, fresh route to the requested destination.
+    // Until the forged lifetime runs out, data to that destination is
+    // filtered on arrival, whether or not AODV has a route for it.
+    uint64_t GetRreqsSeen() const;
+    uint64_t GetRrepsForged() const;
+    // Forged replies withheld because another colluder holds the flow
+    uint64_t GetRrepsYielded() const;
+    // Rushing: RREQs are rebroadcast at once from the receive path instead
+    // of after AODV's jitter. A race counts as won when the reply to a
+    // rushed request is routed back through this node.
+    uint64_t GetRreqsRushed() const;
+    uint64_t GetRushesWon() const;
+
+    // Sinkhole mode: every SpoofedHelloInterval a single timer tick
+    // broadcasts one prebuilt AODV HELLO per spoofed identity, so the
+    // attacker's neighbours believe all those nodes are one hop away.
+    // Their routes use the identity itself as next hop; the attacker
+    // answers their ARP requests for it, and the traffic that follows is
+    // filtered like traffic to a forged destination.
+    void AddSpoofedIdentity(Ipv4Address identity);
+    void ClearSpoofedIdentities();
+    uint32_t GetNSpoofedIdentities() const;
+    uint64_t GetSpoofedHellosSent() const;
+    // Distinct neighbours heard sending their own HELLOs
+    uint32_t GetNNeighborsHeard() const;
+    // Distinct (neighbour, spoofed identity) pairs seen in ARP requests:
+    // each is a bogus route through the identity that is in use. Entries
+    // never used for traffic are not seen, so this is a lower bound.
+    uint64_t GetPollutedEntries() const;
+    uint64_t GetSpoofedArpReplies() const;
+
+    // Wormhole mode: packets this attacker captures are carried over an
+    // in-process tunnel to its peer, which re-injects them towards their
+    // destination. The tunnel bypasses the PHY and MAC entirely; its
+    // capacity is TunnelDataRate (0 for unlimited) plus a fixed TunnelDelay.
+    // Route discovery crosses it too: RREQs heard at one end are
+    // re-broadcast at the other and the RREPs answering them come back, so
+    // the network learns routes through the tunnel.
+    static void LinkWormhole(Ptr<BlackholeAodv> first, Ptr<BlackholeAodv> second);
+    Ptr<BlackholeAodv> GetWormholePeer() const;
+    // Packets and bytes that reached the peer through this end
+    uint64_t GetTunnelledPackets() const;
+    uint64_t GetTunnelledBytes() const;
+    // Captured packets refused because TunnelQueueLimit were in flight;
+    // these are dropped and counted as such. Accepted ones never are.
+    uint64_t GetTunnelDrops() const;
+    // Tunnelled packets this end could not route onwards
+    uint64_t GetTunnelExitDrops() const;
+    // RREQs and RREPs that reached the peer through this end
+    uint64_t GetTunnelledControl() const;
+    // Mean and worst time from capture to re-injection at the peer
+    Time GetTunnelMeanLatency() const;
+    Time GetTunnelMaxLatency() const;
+
+    // Compact binary record of one drop/forward decision (24 bytes)
+    struct EventRecord {
+        int64_t timeNs;       // Simulation time of the decision
+        uint32_t source;      // IPv4 source address (host order)
+        uint32_t destination; // IPv4 destination address (host order)
+        uint32_t size;        // Payload size in bytes
+        uint8_t protocol;     // IPv4 protocol number
+        uint8_t dropped;      // 1 if dropped, 0 if forwarded
+        uint16_t reserved;
+    };
+
+    // Signature of the PacketDropped and PacketForwarded trace sources
+    typedef void (*PacketDecisionTracedCallback)(Ptr<const Packet> packet,
+                                                 const Ipv4Header &header,
+                                                 bool dropped);
+
+    // Selective forwarding rules. The most specific match wins: exact flow,
+    // then source, then the longest destination prefix, then the global
+    // DropProbability.
+    bool AddFlowPolicy(Ipv4Address source, Ipv4Address destination,
+                       uint8_t protocol, uint16_t destinationPort, double probability);
+    bool AddSourcePolicy(Ipv4Address source, double probability);
+    bool AddDestinationPolicy(Ipv4Address prefix, Ipv4Mask mask, double probability);
+    void ClearPolicies();
+    uint32_t GetNPolicies() const;
+
+    // Loads rules from a text file, one per line ('#' starts a comment):
+    //   flow <src> <dst> <protocol> <dst-port> <probability>
+    //   source <src> <probability>
+    //   destination <prefix>/<length> <probability>
+    bool LoadPolicyFile(const std::string &fileName);
+
+    void SetEventRingSize(uint32_t size);
+    uint32_t GetEventRingSize() const;
+
+    // Writes the ring contents, oldest record first, as raw EventRecords
+    // preceded by a small header (magic, record count).
+    void DumpEventRing(std::ostream &os) const;
+
+    // Compile-time policies combined by BlackholeAodvVariant. Each is a
+    // stateless struct of static hooks; being nested, they reach the
+    // attacker's private state without widening its interface. NeedsFlow
+    // tells the filter whether to build the packet's flow key at all.
+
+    // Drop policies
+    struct AlwaysDrop {
+        static bool NeedsFlow(const BlackholeAodv &) { return false; }
+        static bool Decide(BlackholeAodv &, const BlackholeFlowKey &) { return true; }
+    };
+    struct BernoulliDrop {
+        static bool NeedsFlow(const BlackholeAodv &) { return false; }
+        static bool Decide(BlackholeAodv &attacker, const BlackholeFlowKey &) {
+            return attacker.NextDropDecision();
+        }
+    };
+    struct GilbertElliottDrop {
+        static bool NeedsFlow(const BlackholeAodv &) { return false; }
+        static bool Decide(BlackholeAodv &attacker, const BlackholeFlowKey &) {
+            return attacker.NextBurstDecision();
+        }
+    };
+    // Per-flow/source/prefix policy table, falling back to the DropModel
+    struct SelectiveDrop {
+        static bool NeedsFlow(const BlackholeAodv &attacker) { return attacker.m_policies.GetSize() != 0; }
+        static bool Decide(BlackholeAodv &attacker, const BlackholeFlowKey &flow) {
+            const uint64_t *threshold = NeedsFlow(attacker) ? attacker.FindPolicyThreshold(flow) : nullptr;
+            if (threshold) {
+                return attacker.NextDropDecision(*threshold);
+            }
+            return (attacker.m_dropModel == BERNOULLI) ? attacker.NextDropDecision()
+                                                       : attacker.NextBurstDecision();
+        }
+    };
+
+    // Applies Inner only while the activity schedule says the attacker is on
+    template <typename Inner>
+    struct ScheduledDrop {
+        static bool NeedsFlow(const BlackholeAodv &attacker) { return Inner::NeedsFlow(attacker); }
+        static bool Decide(BlackholeAodv &attacker, const BlackholeFlowKey &flow) {
+            return attacker.IsActive() && Inner::Decide(attacker, flow);
+        }
+    };
+
+    // Accounting policies
+    struct TotalsAccounting {
+        static bool NeedsFlow(const BlackholeAodv &) { return false; }
+        static void Count(BlackholeAodv &attacker, const BlackholeFlowKey &, uint32_t bytes, bool dropped) {
+            attacker.CountTotals(bytes, dropped);
+        }
+    };
+    struct FlowAccounting {
+        static bool NeedsFlow(const BlackholeAodv &) { return true; }
+        static void Count(BlackholeAodv &attacker, const BlackholeFlowKey &flow, uint32_t bytes, bool dropped) {
+            attacker.CountTotals(bytes, dropped);
+            attacker.Account(flow, attacker.m_currentIdev, bytes, dropped);
+        }
+    };
+    // Per-flow accounting switched at run time by the FlowAccounting attribute
+    struct AttributeAccounting {
+        static bool NeedsFlow(const BlackholeAodv &attacker) { return attacker.m_flowAccounting; }
+        static void Count(BlackholeAodv &attacker, const BlackholeFlowKey &flow, uint32_t bytes, bool dropped) {
+            attacker.CountTotals(bytes, dropped);
+            if (attacker.m_flowAccounting) {
+                attacker.Account(flow, attacker.m_currentIdev, bytes, dropped);
+            }
+        }
+    };
+
+    // Trace policies
+    struct NoTrace {
+        static void Trace(BlackholeAodv &, Ptr<const Packet>, const Ipv4Header &, bool) {}
+    };
+    // Event ring (when sized) plus the PacketDropped/PacketForwarded sources
+    struct FullTrace {
+        static void Trace(BlackholeAodv &attacker, Ptr<const Packet> packet, const Ipv4Header &header,
+                          bool dropped) {
+            if (!attacker.m_eventRing.empty()) {
+                attacker.RecordEvent(packet, header, dropped);
+            }
+            if (dropped) {
+                attacker.m_packetDroppedTrace(packet, header, true);
+            } else {
+                attacker.m_packetForwardedTrace(packet, header, false);
+            }
+        }
+    };
+
+    // Forward policies
+    struct DirectForward {
+        static void Forward(BlackholeAodv &attacker, Ptr<Ipv4Route> route, Ptr<const Packet> packet,
+                            const Ipv4Header &header) {
+            (*attacker.m_currentUcb)(route, packet, header);
+        }
+    };
+    // Holds back a DelayProbability fraction in the jellyfish timer wheel
+    struct JellyfishForward {
+        static void Forward(BlackholeAodv &attacker, Ptr<Ipv4Route> route, Ptr<const Packet> packet,
+                            const Ipv4Header &header) {
+            if (attacker.m_delayThreshold != 0 && (attacker.NextAlignedRandom() >> 1) < attacker.m_delayThreshold) {
+                attacker.DelayPacket(route, packet, header);
+            } else {
+                (*attacker.m_currentUcb)(route, packet, header);
+            }
+        }
+    };
+
+protected:
+    virtual void DoDispose() override;
+
+    // Unicast forward filter composed from the given policies. AODV calls
+    // it in place of the caller's unicast forward callback.
+    template <typename DropPolicy, typename AccountingPolicy, typename TracePolicy,
+              typename ForwardPolicy = DirectForward>
+    void FilterWith(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header) {
+        // RouteInput only routes unicast transit data through the filter;
+        // colluders pass each other's traffic untouched
+        if (m_collude && BlackholeCollusionRegistry::IsMemberAddress(header.GetDestination())) {
+            ForwardUnfiltered(route, packet, header);
+            return;
+        }
+        BlackholeFlowKey flow = {0, 0};
+        if (DropPolicy::NeedsFlow(*this) || AccountingPolicy::NeedsFlow(*this)) {
+            flow = MakePacketFlowKey(packet, header);
+        }
+        bool drop = DropPolicy::Decide(*this, flow);
+        // A captured packet the tunnel accepts is delivered, not dropped;
+        // it is counted by the tunnel alone
+        if (drop && m_wormholePeer && Tunnel(packet, header)) {
+            return;
+        }
+        AccountingPolicy::Count(*this, flow, packet->GetSize(), drop);
+        TracePolicy::Trace(*this, packet, header, drop);
+        if (!drop) {
+            ForwardPolicy::Forward(*this, route, packet, header);
+        }
+        // A dropped packet is swallowed; AODV still believes it was forwarded
+    }
+
+    // Replaces the forward filter, used by specializations
+    void SetForwardFilter(UnicastForwardCallback filter);
 
 private:
+    // Filter of the run-time configurable ns3::BlackholeAodv
+    void FilterForward(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header);
+    // Hands packet to the caller's callback
+    void ForwardUnfiltered(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header);
+    // Flow key of a transit packet
+    static BlackholeFlowKey MakePacketFlowKey(Ptr<const Packet> packet, const Ipv4Header &header);
+    void CountTotals(uint32_t bytes, bool dropped);
+
+    // Number of decisions precomputed per block refill
+    static const uint32_t DECISION_BLOCK_BITS = 4096;
+    static const uint32_t DECISION_BLOCK_WORDS = DECISION_BLOCK_BITS / 64;
+
+    // Draws the next 64-bit value of this node's counter-based stream
+    uint64_t NextRandom();
+    // Like NextRandom(), but takes the counter a pending decision block
+    // would have consumed so the stream stays aligned with block mode
+    uint64_t NextAlignedRandom();
+    // Consumes one drop decision against the global threshold
+    bool NextDropDecision();
+    // Consumes one drop decision against a rule-specific threshold
+    bool NextDropDecision(uint64_t threshold);
+    // Consumes one Gilbert-Elliott decision and advances the chain
+    bool NextBurstDecision();
+    void UpdateBurstThresholds();
+    // Moves the schedule cursor up to now and recomputes m_active
+    void AdvanceSchedule(int64_t now);
+    // Forces AdvanceSchedule on the next IsActive() call
+    void ResetSchedule();
+    void SetScheduleFile(std::string fileName);
+    std::string GetScheduleFile() const;
+
+    // Wire sizes of an AODV RREQ and RREP datagram: UDP header, one type
+    // byte, then the 23-byte RREQ or 19-byte RREP body
+    static const uint32_t RREQ_DATAGRAM_SIZE = 8 + 1 + 23;
+    static const uint32_t RREP_DATAGRAM_SIZE = 8 + 1 + 19;
+
+    // Forges a reply to and/or rushes the RREQ in packet (a UDP datagram)
+    // if it is one; returns true if it was rushed
+    bool HandleRequest(Ptr<const Packet> packet, const Ipv4Header &header, Ptr<const NetDevice> idev);
+    void ForgeReply(uint32_t interface, Ipv4Address previousHop, const uint8_t *rreq);
+    void RushRequest(uint32_t interface, uint8_t ttl, uint8_t *rreq);
+    // Sends the RREQ datagram rreq as a broadcast on interface
+    void BroadcastRequest(uint32_t interface, uint8_t ttl, const uint8_t *rreq);
+    enum RushState : uint8_t { RUSH_PENDING = 1, RUSH_WON = 2 };
+    // Scores a rush won if packet is an RREP answering a rushed request,
+    // tunnels it back if it answers a request the peer sent us, and notes
+    // the sender of a HELLO as a neighbour
+    void ObserveReply(Ptr<const Packet> packet, const Ipv4Header &header);
+    // Serializes the HELLO of one spoofed identity
+    Ptr<Packet> BuildSpoofedHello(Ipv4Address identity) const;
+    void SendSpoofedHellos();
+    // Protocol handler for ARP on every interface; answers requests for a
+    // spoofed identity with our own hardware address
+    // Trace sink for the MAC's dropped MPDUs, where AODV detects breaks
+    void NotifyTxError(WifiMacDropReason reason, Ptr<const WifiMpdu> mpdu);
+    void ReceiveArp(Ptr<NetDevice> device, Ptr<const Packet> packet, uint16_t protocol, const Address &from,
+                    const Address &to, NetDevice::PacketType packetType);
+    // Route of the given interface, reused for every forged packet sent on it
+    Ptr<Ipv4Route> GetSendRoute(uint32_t interface, Ipv4Address gateway);
+    // Serializes the fixed fields of the forged RREP into m_rrepTemplate
+    void BuildRrepTemplate();
+    void SetForgedHopCount(uint8_t hopCount);
+    uint8_t GetForgedHopCount() const;
+    void SetForgedLifetime(Time lifetime);
+    Time GetForgedLifetime() const;
+
+    // Jellyfish timer wheel: two levels, 256 ticks of DelayTick each at
+    // level 0 and 64 slots of 256 ticks at level 1, with entries kept in a
+    // bounded pool and chained by index. Only one scheduler event is ever
+    // pending, set for the next occupied tick or level-1 cascade.
+    static const uint32_t WHEEL0_SLOTS = 256;
+    static const uint32_t WHEEL1_SLOTS = 64;
+    static const uint32_t WHEEL_NONE = 0xFFFFFFFFu;
+
+    struct DelayedPacket {
+        Ptr<Ipv4Route> route;
+        Ptr<const Packet> packet;
+        Ipv4Header header;
+        int64_t releaseTick;
+        uint32_t next;
+    };
+
+    void DelayPacket(Ptr<Ipv4Route> route, Ptr<const Packet> packet, const Ipv4Header &header);
+    // Returns true if the entry went to level 0
+    bool InsertIntoWheel(uint32_t entry);
+    void ProcessWheel();
+    // Earliest tick after m_wheelNow that needs processing, or -1 if idle
+    int64_t NextWheelTick() const;
+    void ScheduleWheel(int64_t tick);
+    // Wormhole tunnel: entry at the capturing end, exit at the peer.
+    // Control payloads are the raw UDP datagram of an RREQ or RREP.
+    enum TunnelPayload { TUNNEL_DATA, TUNNEL_REQUEST, TUNNEL_REPLY };
+    // Returns false if the tunnel is full and the packet must be dropped
+    bool Tunnel(Ptr<const Packet> packet, const Ipv4Header &header, TunnelPayload payload = TUNNEL_DATA);
+    void TunnelArrival(Ptr<const Packet> packet, Ipv4Header header, Time captured, TunnelPayload payload);
+    void TunnelExit(Ptr<const Packet> packet, const Ipv4Header &header);
+    // Remembers where the RREQ came from and sends it to the peer
+    void TunnelRequest(uint32_t interface, const Ipv4Header &header, const uint8_t *rreq);
+    // Re-broadcasts an RREQ from the peer on every interface
+    void TunnelRequestExit(Ptr<const Packet> packet, const Ipv4Header &header);
+    // Relays an RREP from the peer to the hop its RREQ came from
+    void TunnelReplyExit(Ptr<const Packet> packet);
+
+    // Threshold of the most specific matching rule, or nullptr
+    const uint64_t *FindPolicyThreshold(const BlackholeFlowKey &flow);
+    void Account(const BlackholeFlowKey &flow, Ptr<const NetDevice> idev, uint32_t bytes, bool dropped);
+    void RefillDecisionBlock();
+    // Discards precomputed decisions so the next one is drawn afresh
+    void ResetDecisionBlock();
+    void RecordEvent(Ptr<const Packet> packet, const Ipv4Header &header, bool dropped);
+    void SetPolicyFile(std::string fileName);
+    std::string GetPolicyFile() const;
+
     Ptr<Ipv4> m_ipv4;
-    Ptr<UniformRandomVariable> m_randomVar;
-    uint32_t totalDroppedPackets; // Tracks the total number of dropped packets
-    uint32_t totalForwardedPackets; // Tracks the total number of forwarded packets
+    Ptr<aodv::RoutingProtocol> m_aodv;
+    Ptr<NetDevice> m_loopback;
+
+    // Forward filter state; valid only while m_aodv->RouteInput runs
+    UnicastForwardCallback m_forwardFilter;
+    const UnicastForwardCallback *m_currentUcb;
+    Ptr<const NetDevice> m_currentIdev;
+
+    // Output route cache, keyed by destination. Entries of an older
+    // generation are stale; invalidation only bumps the generation.
+    struct CachedRoute {
+        Ptr<Ipv4Route> route;
+        int64_t expires;
+        uint32_t generation;
+    };
+    // Classes of received packets, decided before any drop logic runs
+    enum PacketClass {
+        PACKET_DATA,      // Unicast transit data, the only class filtered
+        PACKET_CONTROL,   // AODV control (UDP 654 -> 654, AODV type byte)
+        PACKET_BROADCAST, // Broadcast and multicast
+        PACKET_LOCAL      // Unicast to this node
+    };
+    PacketClass Classify(Ptr<const Packet> packet, const Ipv4Header &header) const;
+    bool RouteControl(Ptr<const Packet> packet,
+                      const Ipv4Header &header,
+                      Ptr<const NetDevice> idev,
+                      const UnicastForwardCallback &ucb,
+                      const MulticastForwardCallback &mcb,
+                      const LocalDeliverCallback &lcb,
+                      const ErrorCallback &ecb);
+
+    // Unicast and subnet broadcast addresses of this node's up interfaces,
+    // sorted; rebuilt by the Notify* methods, which are rare next to
+    // RouteInput lookups
+    void RefreshLocalAddresses();
+    bool IsLocalAddress(Ipv4Address address) const;
+    bool IsBroadcastAddress(Ipv4Address address) const;
+    std::vector<uint32_t> m_localAddresses;
+    std::vector<uint32_t> m_broadcastAddresses;
+
+    // True if packet is an AODV message that may change routes
+    bool IsRouteChange(Ptr<const Packet> packet) const;
+    BlackholeFlowTable<CachedRoute> m_routeCache;
+    Time m_routeCacheLifetime;
+    uint32_t m_maxCachedRoutes;
+    uint32_t m_routeGeneration;
+    uint64_t m_routeCacheHits;
+    uint64_t m_routeCacheMisses;
+
+    uint64_t totalDroppedPackets; // Tracks the total number of dropped packets
+    uint64_t totalForwardedPackets; // Tracks the total number of forwarded packets
+    uint64_t totalDroppedBytes;
+    uint64_t totalForwardedBytes;
     double dropProbability; // Probability of dropping a packet
+    uint64_t m_dropThreshold; // dropProbability scaled to [0, 2^63]
+
+    // Gilbert-Elliott state; thresholds are scaled to [0, 2^32] and compared
+    // against the two 32-bit halves of a single draw
+    DropModel m_dropModel;
+    bool m_burstBad;
+    double m_goodDropProbability;
+    double m_badDropProbability;
+    double m_goodToBadProbability;
+    double m_badToGoodProbability;
+    uint64_t m_goodDropThreshold;
+    uint64_t m_badDropThreshold;
+    uint64_t m_goodToBadThreshold;
+    uint64_t m_badToGoodThreshold;
+
+    // Activity schedule in time steps; intervals are sorted and disjoint
+    struct ActiveInterval {
+        int64_t start;
+        int64_t stop;
+    };
+    std::vector<ActiveInterval> m_intervals;
+    uint32_t m_intervalCursor;
+    Time m_activeStart;
+    Time m_activeOn; // Zero disables the periodic pattern
+    Time m_activeOff;
+    std::string m_scheduleFile;
+    bool m_active;
+    int64_t m_nextTransition; // IsActive() is a single compare until then
+
+    // Forged RREP state. The template holds a complete UDP + RREP datagram;
+    // only destination, sequence number and originator are patched per reply.
+    bool m_forgeRreps;
+    bool m_collude;
+    uint64_t m_rrepsYielded;
+    bool m_rushRreqs;
+    BlackholeFlowTable<uint8_t> m_rushedRequests; // (origin, destination) -> RUSH_PENDING/RUSH_WON
+    // (origin, RREQ id) of requests already handled, like AODV's own id
+    // cache; ids only grow, so entries need no expiry and the table is
+    // simply cleared when full
+    static const uint32_t MAX_SEEN_REQUESTS = 4096;
+    BlackholeFlowTable<uint8_t> m_seenRequests;
+    uint64_t m_rreqsRushed;
+    uint64_t m_rushesWon;
+
+    // Sinkhole state; one HELLO per identity, copied (not rebuilt) per tick
+    std::vector<Ipv4Address> m_spoofedIdentities;
+    std::vector<Ptr<Packet>> m_spoofedHellos;
+    uint32_t m_maxSpoofedIdentities;
+    Time m_spoofedHelloInterval;
+    EventId m_helloEvent;
+    uint64_t m_spoofedHellosSent;
+    BlackholeFlowTable<int64_t> m_neighborsHeard; // -> time of the last HELLO (time steps)
+    BlackholeFlowTable<uint8_t> m_pollutedEntries; // (neighbour, identity)
+    std::vector<Ptr<NetDevice>> m_arpDevices;      // Devices ReceiveArp and NotifyTxError hook
+    uint64_t m_spoofedArpReplies;
+    uint8_t m_forgedHopCount;
+    uint32_t m_seqNoBoost;
+    Time m_forgedLifetime;
+    uint8_t m_rrepTemplate[RREP_DATAGRAM_SIZE];
+    std::vector<Ptr<Ipv4Route>> m_replyRoutes; // Per interface, gateway patched per reply
+    uint64_t m_rreqsSeen;
+    uint64_t m_rrepsForged;
+    // Destinations this node forged RREPs for, or relayed tunnelled RREPs
+    // for -> expiry (time steps). At most one entry per destination in the
+    // network, so never trimmed.
+    BlackholeFlowTable<int64_t> m_forgedRoutes;
+    bool IsForgedDestination(Ipv4Address destination);
+    uint32_t m_nodeId;
+
+    // Jellyfish state
+    double m_delayProbability;
+    uint64_t m_delayThreshold;
+    Ptr<RandomVariableStream> m_delayVariable;
+    Time m_delayTick;
+    uint32_t m_maxDelayedPackets;
+    UnicastForwardCallback m_delayUcb; // Ipv4L3Protocol's forward callback
+    std::vector<DelayedPacket> m_delayPool;
+    uint32_t m_delayFree;              // Free list through DelayedPacket::next
+    uint32_t m_wheel0[WHEEL0_SLOTS];
+    uint32_t m_wheel1[WHEEL1_SLOTS];
+    uint64_t m_wheel0Occupied[WHEEL0_SLOTS / 64];
+    uint32_t m_wheel0Count;
+    uint32_t m_wheel1Count;
+    int64_t m_wheelNow;                // Last processed tick
+    int64_t m_wheelScheduledTick;      // Tick of m_wheelEvent, -1 if none
+    EventId m_wheelEvent;
+    uint64_t m_delayedPackets;
+    uint64_t m_delayOverflows;
+
+    // Wormhole state. Packets leave the tunnel in order, so the tunnel is
+    // modelled by the time its entry is busy until.
+    Ptr<BlackholeAodv> m_wormholePeer;
+    DataRate m_tunnelDataRate;
+    Time m_tunnelDelay;
+    uint32_t m_tunnelQueueLimit;
+    uint32_t m_tunnelInFlight;
+    Time m_tunnelBusyUntil;
+    uint64_t m_tunnelledPackets;
+    uint64_t m_tunnelledBytes;
+    uint64_t m_tunnelDrops;
+    uint64_t m_tunnelExitDrops;
+    uint64_t m_tunnelledControl;
+    // Requests sent into the tunnel, (origin, destination) -> the hop and
+    // interface they came from; and at the other end, the requests
+    // re-broadcast from it, whose replies go back. Both are cleared when
+    // full, like m_seenRequests.
+    struct WormholeRequest {
+        uint32_t previousHop;
+        uint32_t interface;
+    };
+    BlackholeFlowTable<WormholeRequest> m_wormholeRequests;
+    BlackholeFlowTable<uint8_t> m_wormholeReplies;
+    Time m_tunnelLatencySum;
+    Time m_tunnelMaxLatency;
+
+    // Philox counter-based generator: key is (run seed, node id), the
+    // counter is (packet counter, run number)
+    uint32_t m_rngKey[2];
+    uint64_t m_rngRun;
+    uint64_t m_packetCounter;
+
+    // Block-pregenerated decisions: bit i of the block is the decision for
+    // counter m_decisionBase + i, identical to what NextRandom() would give
+    bool m_blockDecisions;
+    alignas(64) uint64_t m_decisionBits[DECISION_BLOCK_WORDS];
+    uint64_t m_decisionBase;
+    uint32_t m_decisionIndex;
+
+    // Policy rules keyed by BlackholeFlowKey; values are drop thresholds
+    BlackholeFlowTable<uint64_t> m_policies;
+    uint64_t m_prefixLengths; // Bit n set if a /n destination rule exists
+    std::string m_policyFile;
+
+    bool m_flowAccounting;
+    uint32_t m_maxTrackedFlows;
+    BlackholeFlowTable<Counters> m_flowStats;
+    Counters m_untrackedFlows;
+    std::vector<Counters> m_interfaceStats;
+
+    TracedCallback<Ptr<const Packet>, const Ipv4Header &, bool> m_packetDroppedTrace;
+    TracedCallback<Ptr<const Packet>, const Ipv4Header &, bool> m_packetForwardedTrace;
+
+    std::vector<EventRecord> m_eventRing; // Fixed-size ring, empty when disabled
+    uint32_t m_eventRingPos;              // Next slot to overwrite
+    uint64_t m_eventRingWritten;          // Total records ever written
+};
+
+// BlackholeAodv with its forward filter fixed at compile time, so that
+// e.g. an always-drop, count-only attacker pays for neither random draws
+// nor flow lookups. Attributes of the policies left out are ignored.
+template <typename DropPolicy, typename AccountingPolicy, typename TracePolicy,
+          typename ForwardPolicy = BlackholeAodv::DirectForward>
+class BlackholeAodvVariant : public BlackholeAodv {
+public:
+    static TypeId GetTypeId(void);
+
+    BlackholeAodvVariant() {
+        SetForwardFilter(MakeCallback(
+            &BlackholeAodvVariant::template FilterWith<DropPolicy, AccountingPolicy, TracePolicy, ForwardPolicy>,
+            this));
+    }
+};
+
+// Specializations registered with the TypeId system
+typedef BlackholeAodvVariant<BlackholeAodv::AlwaysDrop, BlackholeAodv::TotalsAccounting,
+                             BlackholeAodv::NoTrace> BlackholeAodvAlwaysDrop;
+typedef BlackholeAodvVariant<BlackholeAodv::BernoulliDrop, BlackholeAodv::TotalsAccounting,
+                             BlackholeAodv::NoTrace> BlackholeAodvBernoulli;
+typedef BlackholeAodvVariant<BlackholeAodv::SelectiveDrop, BlackholeAodv::FlowAccounting,
+                             BlackholeAodv::NoTrace> BlackholeAodvFlowAccounting;
+typedef BlackholeAodvVariant<BlackholeAodv::GilbertElliottDrop, BlackholeAodv::TotalsAccounting,
+                             BlackholeAodv::NoTrace> BlackholeAodvGilbertElliott;
+
+template <>
+TypeId BlackholeAodvAlwaysDrop::GetTypeId(void);
+template <>
+TypeId BlackholeAodvBernoulli::GetTypeId(void);
+template <>
+TypeId BlackholeAodvFlowAccounting::GetTypeId(void);
+template <>
+TypeId BlackholeAodvGilbertElliott::GetTypeId(void);
+
+// Installs AODV on every node and wraps it in a BlackholeAodv on the nodes
+// registered with AddAttacker.
+class BlackholeAodvHelper : public Ipv4RoutingHelper {
+public:
+    BlackholeAodvHelper();
+
+    BlackholeAodvHelper *Copy() const override;
+    Ptr<Ipv4RoutingProtocol> Create(Ptr<Node> node) const override;
+
+    // Sets an attribute of ns3::aodv::RoutingProtocol on all nodes
+    void Set(std::string name, const AttributeValue &value);
+    // Sets an attribute of ns3::BlackholeAodv on attacker nodes
+    void SetBlackhole(std::string name, const AttributeValue &value);
+    // Selects the attacker type, ns3::BlackholeAodv or one of its variants
+    void SetBlackholeType(std::string typeName);
+
+    void AddAttacker(uint32_t nodeId);
+
+    // Every printInterval, writes the changes to the routing tables of all
+    // nodes since the previous dump as CSV rows
+    // "time,node,op,destination,entry", op being '+' for a new or changed
+    // entry and '-' for a removed one. Expiry times are left out of the
+    // entries, so an entry that is only refreshed produces no row.
+    static void PrintRoutingTableDiffAllEvery(Time printInterval, Ptr<OutputStreamWrapper> stream,
+                                              Time::Unit unit = Time::S);
+
+    // Schedules attribute changes of attackers read from a file with one
+    //   <time-seconds> <node-id> <attribute> <value>
+    // per line. Nodes, attributes and values are resolved when the file is
+    // loaded; all changes sharing a time are applied by one event, and only
+    // the next batch is ever pending. Returns false if a line was skipped.
+    static bool LoadReconfigurationFile(const std::string &fileName);
+
+private:
+    ObjectFactory m_aodvFactory;
+    ObjectFactory m_blackholeFactory;
+    std::set<uint32_t> m_attackers;
 };
 
 } // namespace ns3
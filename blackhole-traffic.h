@@ -0,0 +1,344 @@
+#ifndef BLACKHOLE_TRAFFIC_H
+#define BLACKHOLE_TRAFFIC_H
+
+// Traffic generation and measurement shared by blackhole.cc and
+// blackhole-aodv-perf.cc. Everything is defined in this header.
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cmath>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace ns3 {
+
+// Application header at the start of every payload: flow id, sequence
+// number and send time (ns), 16 bytes in network order
+class FlowSeqHeader : public Header {
+public:
+    FlowSeqHeader() : m_flowId(0), m_seq(0), m_sendTime(0) {}
+
+    static TypeId GetTypeId(void) {
+        static TypeId tid = TypeId("FlowSeqHeader").SetParent<Header>().AddConstructor<FlowSeqHeader>();
+        return tid;
+    }
+    TypeId GetInstanceTypeId(void) const override { return GetTypeId(); }
+
+    uint32_t GetSerializedSize(void) const override { return SIZE; }
+    void Serialize(Buffer::Iterator start) const override {
+        start.WriteHtonU32(m_flowId);
+        start.WriteHtonU32(m_seq);
+        start.WriteHtonU64(m_sendTime);
+    }
+    uint32_t Deserialize(Buffer::Iterator start) override {
+        m_flowId = start.ReadNtohU32();
+        m_seq = start.ReadNtohU32();
+        m_sendTime = start.ReadNtohU64();
+        return SIZE;
+    }
+    void Print(std::ostream &os) const override {
+        os << "flow=" << m_flowId << " seq=" << m_seq << " sent=" << m_sendTime << "ns";
+    }
+
+    static const uint32_t SIZE = 16;
+
+    uint32_t m_flowId;
+    uint32_t m_seq;
+    uint64_t m_sendTime; // Time steps (ns)
+};
+
+// Receiver-side sequence accounting over a 64-packet sliding window. Bit i
+// of the window is set if sequence number highest - i has arrived; a zero
+// bit shifted out of the window is a lost packet. Each packet costs O(1).
+struct SequenceTracker {
+    bool started = false;
+    uint32_t highest = 0;
+    uint64_t window = 0;
+    uint64_t duplicates = 0;
+    uint64_t reordered = 0; // Arrived after a higher sequence number
+    uint64_t lost = 0;      // Shifted out of the window unseen
+
+    // Returns false for a duplicate
+    bool Record(uint32_t seq) {
+        if (!started) {
+            // Sequence numbers before the first are still awaited
+            started = true;
+            highest = seq;
+            window = 1 | ((seq < 63) ? ~0ULL << (seq + 1) : 0);
+            lost = (seq > 63) ? seq - 63 : 0;
+            return true;
+        }
+        if (seq > highest) {
+            uint32_t shift = seq - highest;
+            if (shift >= 64) {
+                lost += 64 - std::bitset<64>(window).count() + (shift - 64);
+                window = 1;
+            } else {
+                lost += shift - std::bitset<64>(window >> (64 - shift)).count();
+                window = (window << shift) | 1;
+            }
+            highest = seq;
+            return true;
+        }
+        uint32_t offset = highest - seq;
+        if (offset >= 64) {
+            // Already counted lost when it left the window; a duplicate
+            // this late cannot be told apart and is taken as a late arrival
+            reordered++;
+            lost -= (lost > 0);
+            return true;
+        }
+        if ((window >> offset) & 1) {
+            duplicates++;
+            return false;
+        }
+        window |= 1ULL << offset;
+        reordered++;
+        return true;
+    }
+
+    // Lost so far, counting gaps still inside the window
+    uint64_t GetLost() const {
+        return started ? lost + (64 - std::bitset<64>(window).count()) : 0;
+    }
+};
+
+// Log-linear latency histogram in the style of HdrHistogram, in
+// microseconds. Values below 128 us get one bucket each; above that every
+// power of two is split into 64 linear sub-buckets, so any value is kept to
+// within 1/64 (~1.6%). Memory is fixed (6 KB) and histograms merge by
+// adding counts.
+class LatencyHistogram {
+public:
+    static const uint32_t SUB_BITS = 6;
+    static const uint32_t SUB_COUNT = 1u << SUB_BITS;
+    static const uint32_t MAX_SHIFT = 22; // Up to ~2^29 us (~9 min)
+    static const uint32_t BUCKETS = (MAX_SHIFT + 2) * SUB_COUNT;
+
+    LatencyHistogram() : m_counts(), m_total(0), m_sum(0), m_max(0) {}
+
+    void Record(Time value) {
+        int64_t us = value.GetMicroSeconds();
+        uint64_t v = us > 0 ? us : 0;
+        m_counts[Index(v)]++;
+        m_total++;
+        m_sum += v;
+        m_max = std::max(m_max, v);
+    }
+
+    void Merge(const LatencyHistogram &other) {
+        for (uint32_t i = 0; i < BUCKETS; ++i) {
+            m_counts[i] += other.m_counts[i];
+        }
+        m_total += other.m_total;
+        m_sum += other.m_sum;
+        m_max = std::max(m_max, other.m_max);
+    }
+
+    uint64_t GetCount(void) const { return m_total; }
+    Time GetMean(void) const { return m_total ? MicroSeconds(m_sum / m_total) : Time(0); }
+    Time GetMax(void) const { return MicroSeconds(m_max); }
+
+    // Value at quantile q in [0, 1], reported as the middle of its bucket
+    Time GetQuantile(double q) const {
+        if (m_total == 0) {
+            return Time(0);
+        }
+        uint64_t rank = std::max<uint64_t>(1, std::ceil(q * m_total));
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < BUCKETS; ++i) {
+            seen += m_counts[i];
+            if (seen >= rank) {
+                return MicroSeconds(std::min(m_max, (Lowest(i) + Lowest(i + 1)) / 2));
+            }
+        }
+        return MicroSeconds(m_max);
+    }
+
+    // One "<lowest-us>,<count>" line per non-empty bucket, so runs can be
+    // merged offline by summing counts per bucket
+    void Write(std::ostream &os, const std::string &prefix) const {
+        for (uint32_t i = 0; i < BUCKETS; ++i) {
+            if (m_counts[i]) {
+                os << prefix << Lowest(i) << "," << m_counts[i] << "\n";
+            }
+        }
+    }
+
+private:
+    static uint32_t Index(uint64_t v) {
+        if (v < 2 * SUB_COUNT) {
+            return v;
+        }
+        // v >> shift keeps the top SUB_BITS + 1 bits, in [SUB_COUNT, 2 * SUB_COUNT)
+        uint32_t shift = 63 - __builtin_clzll(v) - SUB_BITS;
+        if (shift > MAX_SHIFT) {
+            return BUCKETS - 1;
+        }
+        return shift * SUB_COUNT + (v >> shift);
+    }
+
+    static uint64_t Lowest(uint32_t index) {
+        if (index < 2 * SUB_COUNT) {
+            return index;
+        }
+        uint32_t shift = index / SUB_COUNT - 1;
+        return uint64_t(index % SUB_COUNT + SUB_COUNT) << shift;
+    }
+
+    std::array<uint32_t, BUCKETS> m_counts;
+    uint64_t m_total;
+    uint64_t m_sum; // us
+    uint64_t m_max; // us
+};
+
+// Constant-rate UDP source. Only the next send is ever scheduled, so the
+// event queue holds one entry per flow however long the run is. Send times
+// are derived from the packet count, not accumulated, so they do not drift.
+// Start and stop are the usual Application StartTime and StopTime.
+class CbrSource : public Application {
+public:
+    static TypeId GetTypeId(void) {
+        static TypeId tid = TypeId("CbrSource")
+            .SetParent<Application>()
+            .AddConstructor<CbrSource>()
+            .AddAttribute("Remote",
+                          "Destination address and port",
+                          AddressValue(),
+                          MakeAddressAccessor(&CbrSource::m_remote),
+                          MakeAddressChecker())
+            .AddAttribute("FlowId",
+                          "Flow id written into every packet",
+                          UintegerValue(0),
+                          MakeUintegerAccessor(&CbrSource::m_flowId),
+                          MakeUintegerChecker<uint32_t>())
+            .AddAttribute("PacketRate",
+                          "Packets sent per second",
+                          DoubleValue(1024),
+                          MakeDoubleAccessor(&CbrSource::m_packetRate),
+                          MakeDoubleChecker<double>(0.001))
+            .AddAttribute("PacketSize",
+                          "Payload bytes per packet, FlowSeqHeader included",
+                          UintegerValue(1024),
+                          MakeUintegerAccessor(&CbrSource::m_packetSize),
+                          MakeUintegerChecker<uint32_t>(FlowSeqHeader::SIZE));
+        return tid;
+    }
+
+    CbrSource() : m_flowId(0), m_packetRate(1024), m_packetSize(1024), m_packetsSent(0) {}
+
+    uint64_t GetSent(void) const { return m_packetsSent; }
+
+private:
+    void StartApplication() override {
+        m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+        m_socket->Connect(m_remote);
+        m_firstSend = Simulator::Now();
+        m_packetsSent = 0;
+        SendPacket();
+    }
+
+    void StopApplication() override {
+        m_sendEvent.Cancel();
+        if (m_socket) {
+            m_socket->Close();
+            m_socket = nullptr;
+        }
+    }
+
+    void SendPacket() {
+        Ptr<Packet> packet = Create<Packet>(m_packetSize - FlowSeqHeader::SIZE);
+        FlowSeqHeader header;
+        header.m_flowId = m_flowId;
+        header.m_seq = m_packetsSent;
+        header.m_sendTime = Simulator::Now().GetTimeStep();
+        packet->AddHeader(header);
+        m_socket->Send(packet);
+        m_packetsSent++;
+        Time next = m_firstSend + Seconds(m_packetsSent / m_packetRate);
+        m_sendEvent = Simulator::Schedule(next - Simulator::Now(), &CbrSource::SendPacket, this);
+    }
+
+    Address m_remote;
+    uint32_t m_flowId;
+    double m_packetRate; // Packets per second
+    uint32_t m_packetSize;
+    Ptr<Socket> m_socket;
+    EventId m_sendEvent;
+    Time m_firstSend;
+    uint64_t m_packetsSent;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(CbrSource);
+
+// UDP sink for one CbrSource: counts what arrives on Port and keeps its own
+// sequence and delay statistics
+class CbrSink : public Application {
+public:
+    static TypeId GetTypeId(void) {
+        static TypeId tid = TypeId("CbrSink")
+            .SetParent<Application>()
+            .AddConstructor<CbrSink>()
+            .AddAttribute("Port",
+                          "UDP port to receive on",
+                          UintegerValue(9),
+                          MakeUintegerAccessor(&CbrSink::m_port),
+                          MakeUintegerChecker<uint16_t>());
+        return tid;
+    }
+
+    CbrSink() : m_port(9), m_received(0), m_receivedBytes(0) {}
+
+    uint64_t GetReceived(void) const { return m_received; }
+    uint64_t GetReceivedBytes(void) const { return m_receivedBytes; }
+    const SequenceTracker &GetSequence(void) const { return m_sequence; }
+    const LatencyHistogram &GetLatency(void) const { return m_latency; }
+
+private:
+    void StartApplication() override {
+        m_socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+        m_socket->Bind(InetSocketAddress(Ipv4Address::GetAny(), m_port));
+        m_socket->SetRecvCallback(MakeCallback(&CbrSink::Receive, this));
+    }
+
+    void StopApplication() override {
+        if (m_socket) {
+            m_socket->Close();
+            m_socket = nullptr;
+        }
+    }
+
+    void Receive(Ptr<Socket> socket) {
+        FlowSeqHeader header;
+        while (Ptr<Packet> packet = socket->Recv()) {
+            if (packet->GetSize() < FlowSeqHeader::SIZE) {
+                continue;
+            }
+            packet->PeekHeader(header);
+            if (!m_sequence.Record(header.m_seq)) {
+                continue;
+            }
+            m_received++;
+            m_receivedBytes += packet->GetSize();
+            m_latency.Record(Simulator::Now() - TimeStep(header.m_sendTime));
+        }
+    }
+
+    uint16_t m_port;
+    Ptr<Socket> m_socket;
+    uint64_t m_received;
+    uint64_t m_receivedBytes;
+    SequenceTracker m_sequence;
+    LatencyHistogram m_latency;
+};
+
+NS_OBJECT_ENSURE_REGISTERED(CbrSink);
+
+} // namespace ns3
+
+#endif // BLACKHOLE_TRAFFIC_H
@@ -7,6 +7,13 @@
 #include "ns3/applications-module.h"
 #include "ns3/flow-monitor-module.h"
 #include "/home/uwe/ns3/ns-allinone-3.43/ns-3.43/src/aodv/model/blackhole-aodv.h"
+#include "blackhole-traffic.h"
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <queue>
+#include <sstream>
 
 using namespace ns3;
 
@@ -15,18 +22,189 @@ NS_LOG_COMPONENT_DEFINE("EnhancedBlackholeSimulation");
 // Global metrics
 uint32_t totalSentPackets = 0;
 uint32_t totalReceivedPackets = 0;
-Time totalDelay = Seconds(0);
+uint64_t totalReceivedBytes = 0;
+
+// A traffic flow plus its statistics. Flows live in a flat array indexed by
+// flow id, which every packet carries in its FlowSeqHeader.
+struct Flow {
+    uint32_t source;
+    uint32_t destination;
+    double packetRate; // Packets per second
+    uint32_t packetSize;
+    Time start;
+    Time stop;
+    Ptr<Socket> socket; // Created at the first send
+    uint64_t sentPackets;
+    uint64_t receivedPackets;
+    uint64_t receivedBytes;
+    SequenceTracker sequence;
+};
+
+const uint16_t FLOW_BASE_PORT = 10000;
+std::vector<Flow> flows;
+// Delay histograms, kept apart from the flows so that growing the flow
+// table copies no histograms; sized once every flow is registered
+std::vector<LatencyHistogram> flowLatency;
+LatencyHistogram latency; // All flows
 
 // Callback for receiving packets
 void ReceivePacket(Ptr<Socket> socket) {
+    FlowSeqHeader header;
     while (Ptr<Packet> packet = socket->Recv()) {
+        if (packet->GetSize() < FlowSeqHeader::SIZE) {
+            continue;
+        }
+        packet->PeekHeader(header);
+        if (header.m_flowId >= flows.size()) {
+            continue;
+        }
+        Flow &flow = flows[header.m_flowId];
+        if (!flow.sequence.Record(header.m_seq)) {
+            continue;
+        }
+        Time delay = Simulator::Now() - TimeStep(header.m_sendTime);
         totalReceivedPackets++;
-        TimestampTag timestamp;
-        if (packet->PeekPacketTag(timestamp)) {
-            Time delay = Simulator::Now() - timestamp.GetTimestamp();
-            totalDelay += delay;
+        totalReceivedBytes += packet->GetSize();
+        latency.Record(delay);
+        flow.receivedPackets++;
+        flow.receivedBytes += packet->GetSize();
+        flowLatency[header.m_flowId].Record(delay);
+    }
+}
+
+// Writes the header of the next packet of flowId into packet
+void StampPacket(Ptr<Packet> packet, uint32_t flowId) {
+    Flow &flow = flows[flowId];
+    FlowSeqHeader header;
+    header.m_flowId = flowId;
+    header.m_seq = flow.sentPackets++;
+    header.m_sendTime = Simulator::Now().GetTimeStep();
+    packet->AddHeader(header);
+    totalSentPackets++;
+}
+
+// Sends every matrix flow of one node from a single timer. Pending sends
+// are kept in a min-heap of (deadline, flow id), so the node has one event
+// queued whatever its number of flows. Sockets, and the receive socket at
+// the destination, are created when a flow first sends.
+class MatrixSource : public Application {
+public:
+    static TypeId GetTypeId(void) {
+        static TypeId tid = TypeId("MatrixSource").SetParent<Application>().AddConstructor<MatrixSource>();
+        return tid;
+    }
+
+    void AddFlow(uint32_t flowId) { m_flowIds.push_back(flowId); }
+
+private:
+    typedef std::pair<int64_t, uint32_t> Deadline; // (time step, flow id)
+
+    void StartApplication() override {
+        for (uint32_t flowId : m_flowIds) {
+            Schedule(flowId, flows[flowId].start);
         }
+        Rearm();
     }
+
+    void StopApplication() override {
+        m_event.Cancel();
+        m_deadlines = std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>>();
+    }
+
+    void Schedule(uint32_t flowId, Time at) {
+        if (at < flows[flowId].stop) {
+            m_deadlines.push(Deadline(at.GetTimeStep(), flowId));
+        }
+    }
+
+    void Rearm() {
+        if (!m_deadlines.empty()) {
+            m_event = Simulator::Schedule(TimeStep(m_deadlines.top().first) - Simulator::Now(),
+                                          &MatrixSource::Service, this);
+        }
+    }
+
+    // Sends for every flow whose deadline has come, earliest first
+    void Service() {
+        int64_t now = Simulator::Now().GetTimeStep();
+        while (!m_deadlines.empty() && m_deadlines.top().first <= now) {
+            uint32_t flowId = m_deadlines.top().second;
+            m_deadlines.pop();
+            Flow &flow = flows[flowId];
+            if (!flow.socket) {
+                Open(flowId);
+            }
+            Ptr<Packet> packet = Create<Packet>(flow.packetSize - FlowSeqHeader::SIZE);
+            StampPacket(packet, flowId);
+            flow.socket->Send(packet);
+            Schedule(flowId, flow.start + Seconds(flow.sentPackets / flow.packetRate));
+        }
+        Rearm();
+    }
+
+    void Open(uint32_t flowId) {
+        Flow &flow = flows[flowId];
+        uint16_t port = FLOW_BASE_PORT + flowId;
+        Ptr<Node> destination = NodeList::GetNode(flow.destination);
+        Ptr<Socket> sink = Socket::CreateSocket(destination, UdpSocketFactory::GetTypeId());
+        sink->Bind(InetSocketAddress(Ipv4Address::GetAny(), port));
+        sink->SetRecvCallback(MakeCallback(&ReceivePacket));
+        Ipv4Address address = destination->GetObject<Ipv4>()->GetAddress(1, 0).GetLocal();
+        flow.socket = Socket::CreateSocket(GetNode(), UdpSocketFactory::GetTypeId());
+        flow.socket->Connect(InetSocketAddress(address, port));
+    }
+
+    std::vector<uint32_t> m_flowIds;
+    std::priority_queue<Deadline, std::vector<Deadline>, std::greater<Deadline>> m_deadlines;
+    EventId m_event;
+};
+
+// Reads one "<src> <dst> <rate-pps> <size-bytes> <start-s> <stop-s>" flow
+// per line and installs one MatrixSource on every source node. Returns
+// the number of flows loaded.
+uint32_t LoadTrafficMatrix(const std::string &fileName, NodeContainer &nodes) {
+    std::ifstream file(fileName);
+    if (!file) {
+        return 0;
+    }
+    std::vector<Ptr<MatrixSource>> sources(nodes.GetN());
+    // One flow per line at most
+    std::istreambuf_iterator<char> begin(file), end;
+    flows.reserve(flows.size() + std::count(begin, end, '\n') + 1);
+    file.clear();
+    file.seekg(0);
+    std::string line;
+    uint32_t lineNumber = 0;
+    while (BlackholeReadConfigLine(file, line, lineNumber)) {
+        // Every flow needs a port of its own above FLOW_BASE_PORT
+        if (flows.size() >= 65536u - FLOW_BASE_PORT) {
+            NS_LOG_WARN("Flow limit of " << 65536u - FLOW_BASE_PORT << " reached at " << fileName << ":"
+                        << lineNumber << "; ignoring the rest of the file");
+            break;
+        }
+        std::istringstream fields(line);
+        Flow flow = Flow();
+        double rate, start, stop;
+        if (!(fields >> flow.source >> flow.destination >> rate >> flow.packetSize >> start >> stop) ||
+            flow.source >= nodes.GetN() || flow.destination >= nodes.GetN() || flow.source == flow.destination ||
+            rate <= 0 || flow.packetSize < FlowSeqHeader::SIZE || start < 0 || start >= stop) {
+            NS_LOG_WARN("Skipping malformed flow at " << fileName << ":" << lineNumber);
+            continue;
+        }
+        flow.packetRate = rate;
+        flow.start = Seconds(start);
+        flow.stop = Seconds(stop);
+        Ptr<MatrixSource> &source = sources[flow.source];
+        if (!source) {
+            source = CreateObject<MatrixSource>();
+            nodes.Get(flow.source)->AddApplication(source);
+        }
+        flow.source = nodes.Get(flow.source)->GetId();
+        flow.destination = nodes.Get(flow.destination)->GetId();
+        source->AddFlow(flows.size());
+        flows.push_back(flow);
+    }
+    return flows.size();
 }
 
 // Log simulation statistics
@@ -34,8 +212,8 @@ void LogStatistics(uint32_t totalNodes, double totalTime) {
     uint32_t totalLostPackets = totalSentPackets - totalReceivedPackets;
     double packetLossRatio = ((double)totalLostPackets / totalSentPackets) * 100.0;
     double packetDeliveryRatio = ((double)totalReceivedPackets / totalSentPackets) * 100.0;
-    double averageThroughput = (totalReceivedPackets * 1024 * 8) / (totalTime * 1000.0);
-    double averageDelay = (totalReceivedPackets > 0) ? (totalDelay.GetSeconds() / totalReceivedPackets) : -1.0;
+    double averageThroughput = (totalReceivedBytes * 8) / (totalTime * 1000.0);
+    double averageDelay = (totalReceivedPackets > 0) ? latency.GetMean().GetSeconds() : -1.0;
 
     std::cout << "\n-------- Simulation Results --------" << std::endl;
     std::cout << "Total Nodes: " << totalNodes << std::endl;
@@ -47,6 +225,11 @@ void LogStatistics(uint32_t totalNodes, double totalTime) {
     std::cout << "Packet Delivery Ratio: " << packetDeliveryRatio << "%" << std::endl;
     std::cout << "Average Throughput: " << averageThroughput << " Kbps" << std::endl;
     std::cout << "Average End-to-End Delay: " << ((averageDelay >= 0) ? averageDelay : -1) << " seconds" << std::endl;
+    if (latency.GetCount() > 0) {
+        std::cout << "End-to-End Delay p50/p99/p99.9/max: " << latency.GetQuantile(0.5).GetSeconds() << " / "
+                  << latency.GetQuantile(0.99).GetSeconds() << " / " << latency.GetQuantile(0.999).GetSeconds()
+                  << " / " << latency.GetMax().GetSeconds() << " seconds" << std::endl;
+    }
 }
 
 int main() {
@@ -55,6 +238,7 @@ int main() {
     double simTime = 10.0;
     uint32_t trafficRate = 1024;  // Packets per second
     std::vector<uint32_t> blackholeNodes = {10, 15, 25, 35, 40, 55};
+    bool wormhole = false;  // Tunnel between the first and last attacker
 
     // Create nodes
     NodeContainer nodeContainer;
@@ -83,18 +267,29 @@ int main() {
     wifiMac.SetType("ns3::AdhocWifiMac");
     NetDeviceContainer devices = wifiHelper.Install(wifiPhy, wifiMac, nodeContainer);
 
-    // Install Internet stack
-    AodvHelper aodvHelper;
+    // Install Internet stack; attackers get AODV wrapped in BlackholeAodv
+    BlackholeAodvHelper aodvHelper;
+    // Keep the last drop/forward decisions of every attacker in memory
+    aodvHelper.SetBlackhole("EventRingSize", UintegerValue(65536));
+    // The attackers cooperate rather than compete for the same flows
+    aodvHelper.SetBlackhole("Collude", BooleanValue(true));
+    for (uint32_t nodeIndex : blackholeNodes) {
+        aodvHelper.AddAttacker(nodeContainer.Get(nodeIndex)->GetId());
+    }
     InternetStackHelper internet;
     internet.SetRoutingHelper(aodvHelper);
     internet.Install(nodeContainer);
 
     // Configure blackhole nodes
+    std::vector<Ptr<BlackholeAodv>> blackholeRoutings;
     for (uint32_t nodeIndex : blackholeNodes) {
         Ptr<Node> blackholeNode = nodeContainer.Get(nodeIndex);
-        Ptr<BlackholeAodv> blackholeRouting = CreateObject<BlackholeAodv>();
+        Ptr<BlackholeAodv> blackholeRouting = blackholeNode->GetObject<BlackholeAodv>();
         //blackholeRouting->InitializeTrustScores(nodes);
-        blackholeNode->AggregateObject(blackholeRouting);
+        blackholeRoutings.push_back(blackholeRouting);
+    }
+    if (wormhole) {
+        BlackholeAodv::LinkWormhole(blackholeRoutings.front(), blackholeRoutings.back());
     }
 
     // Assign IP addresses
@@ -102,29 +297,42 @@ int main() {
     ipv4.SetBase("10.1.1.0", "255.255.255.0");
     Ipv4InterfaceContainer interfaces = ipv4.Assign(devices);
 
-    // UDP traffic setup
-    TypeId tid = TypeId::LookupByName("ns3::UdpSocketFactory");
-    Ptr<Socket> sourceSocket = Socket::CreateSocket(nodeContainer.Get(1), tid);
-    InetSocketAddress remote = InetSocketAddress(interfaces.GetAddress(nodes - 1), 9);
-    sourceSocket->Connect(remote);
-
-    Ptr<Socket> recvSocket = Socket::CreateSocket(nodeContainer.Get(nodes - 1), tid);
-    InetSocketAddress local = InetSocketAddress(Ipv4Address::GetAny(), 9);
-    recvSocket->Bind(local);
-    recvSocket->SetRecvCallback(MakeCallback(&ReceivePacket));
+    // UDP traffic: the flows of traffic-matrix.txt if present, else a single
+    // flow from node 1 to the last node, which keeps its own statistics
+    Ptr<CbrSource> cbrSource;
+    Ptr<CbrSink> cbrSink;
+    if (LoadTrafficMatrix("traffic-matrix.txt", nodeContainer) == 0) {
+        Flow flow = Flow();
+        flow.source = nodeContainer.Get(1)->GetId();
+        flow.destination = nodeContainer.Get(nodes - 1)->GetId();
+        flow.packetRate = trafficRate;
+        flow.packetSize = 1024;
+        flow.start = Seconds(0);
+        flow.stop = Seconds(simTime);
+        flows.push_back(flow);
 
-    double packetInterval = 1.0 / trafficRate;
+        cbrSource = CreateObject<CbrSource>();
+        cbrSource->SetAttribute("FlowId", UintegerValue(0));
+        cbrSource->SetAttribute("Remote", AddressValue(InetSocketAddress(interfaces.GetAddress(nodes - 1), 9)));
+        cbrSource->SetAttribute("PacketRate", DoubleValue(trafficRate));
+        cbrSource->SetAttribute("PacketSize", UintegerValue(1024)); // Fixed size for debugging
+        nodeContainer.Get(1)->AddApplication(cbrSource);
+        cbrSource->SetStartTime(Seconds(0));
+        cbrSource->SetStopTime(Seconds(simTime));
 
-    for (uint32_t i = 0; i < trafficRate * simTime; ++i) {
-        Simulator::Schedule(Seconds(i * packetInterval), [sourceSocket]() {
-            Ptr<Packet> packet = Create<Packet>(1024); // Fixed size for debugging
-            TimestampTag timestamp;
-            timestamp.SetTimestamp(Simulator::Now());
-            packet->AddPacketTag(timestamp);
-            sourceSocket->Send(packet);
-            totalSentPackets++;
-        });
+        cbrSink = CreateObject<CbrSink>();
+        cbrSink->SetAttribute("Port", UintegerValue(9));
+        nodeContainer.Get(nodes - 1)->AddApplication(cbrSink);
+        cbrSink->SetStartTime(Seconds(0));
     }
+    flowLatency.resize(flows.size());
+
+    // Optional mid-run changes of attacker attributes
+    BlackholeAodvHelper::LoadReconfigurationFile("blackhole-reconfig.txt");
+
+    // Route changes of every node, once per second
+    Ptr<OutputStreamWrapper> routingDiffs = Create<OutputStreamWrapper>("routing-diffs.csv", std::ios::out);
+    BlackholeAodvHelper::PrintRoutingTableDiffAllEvery(Seconds(1), routingDiffs);
 
     // Flow monitor setup
     FlowMonitorHelper flowmonHelper;
@@ -134,9 +342,87 @@ int main() {
     Simulator::Stop(Seconds(simTime));
     Simulator::Run();
 
+    // Fold the default flow's own counters into the flow table and totals
+    if (cbrSource) {
+        Flow &flow = flows[0];
+        flow.sentPackets = cbrSource->GetSent();
+        flow.receivedPackets = cbrSink->GetReceived();
+        flow.receivedBytes = cbrSink->GetReceivedBytes();
+        flow.sequence = cbrSink->GetSequence();
+        flowLatency[0] = cbrSink->GetLatency();
+        totalSentPackets += flow.sentPackets;
+        totalReceivedPackets += flow.receivedPackets;
+        totalReceivedBytes += flow.receivedBytes;
+        latency.Merge(cbrSink->GetLatency());
+    }
+
     // Log results
     LogStatistics(nodes, simTime);
 
+    // Per-flow results
+    std::ofstream flowFile("flow-stats.csv");
+    flowFile << "flow,source,destination,sent,received,bytes,lost,duplicates,reordered,mean_delay_s,p50_delay_s,p99_delay_s,p999_delay_s,max_delay_s\n";
+    for (uint32_t i = 0; i < flows.size(); ++i) {
+        const Flow &flow = flows[i];
+        // Packets after the last one received never entered the window
+        uint64_t trailing = flow.sequence.started ? flow.sentPackets - 1 - flow.sequence.highest : flow.sentPackets;
+        const LatencyHistogram &delay = flowLatency[i];
+        double meanDelay = flow.receivedPackets ? delay.GetMean().GetSeconds() : -1.0;
+        flowFile << i << "," << flow.source << "," << flow.destination << "," << flow.sentPackets << ","
+                 << flow.receivedPackets << "," << flow.receivedBytes << ","
+                 << flow.sequence.GetLost() + trailing << "," << flow.sequence.duplicates << ","
+                 << flow.sequence.reordered << "," << meanDelay << "," << delay.GetQuantile(0.5).GetSeconds() << ","
+                 << delay.GetQuantile(0.99).GetSeconds() << "," << delay.GetQuantile(0.999).GetSeconds() << ","
+                 << delay.GetMax().GetSeconds() << "\n";
+    }
+
+    // Raw latency buckets, global and per flow, for merging across runs
+    std::ofstream latencyFile("latency-histogram.csv");
+    latencyFile << "flow,bucket_us,count\n";
+    latency.Write(latencyFile, "all,");
+    for (uint32_t i = 0; i < flows.size(); ++i) {
+        flowLatency[i].Write(latencyFile, std::to_string(i) + ",");
+    }
+
+    // Per-attacker impact, broken down by the flows each attacker touched
+    BlackholeAodv::AccountingSnapshot snapshot;
+    for (uint32_t i = 0; i < blackholeRoutings.size(); ++i) {
+        blackholeRoutings[i]->Snapshot(snapshot);
+        std::cout << "Attacker " << blackholeNodes[i] << ": dropped " << snapshot.total.droppedPackets
+                  << " packets (" << snapshot.total.droppedBytes << " bytes), forwarded "
+                  << snapshot.total.forwardedPackets << " packets; forged " << blackholeRoutings[i]->GetRrepsForged()
+                  << " RREPs for " << blackholeRoutings[i]->GetRreqsSeen() << " RREQs, yielded "
+                  << blackholeRoutings[i]->GetRrepsYielded() << " to colluders" << std::endl;
+        for (const BlackholeAodv::FlowStats &flow : snapshot.flows) {
+            std::cout << "  " << flow.source << " -> " << flow.destination << ":" << flow.destinationPort
+                      << " dropped " << flow.counters.droppedPackets
+                      << " forwarded " << flow.counters.forwardedPackets << std::endl;
+        }
+    }
+
+    if (wormhole) {
+        for (size_t i : {size_t(0), blackholeRoutings.size() - 1}) {
+            Ptr<BlackholeAodv> end = blackholeRoutings[i];
+            std::cout << "Wormhole end " << blackholeNodes[i] << ": tunnelled "
+                      << end->GetTunnelledPackets() << " packets ("
+                      << end->GetTunnelledBytes() * 8.0 / simTime / 1000 << " Kbps), mean latency "
+                      << end->GetTunnelMeanLatency().GetSeconds() << " s, max "
+                      << end->GetTunnelMaxLatency().GetSeconds() << " s, refused " << end->GetTunnelDrops()
+                      << ", unroutable at exit " << end->GetTunnelExitDrops() << ", control "
+                      << end->GetTunnelledControl() << std::endl;
+        }
+    }
+    std::cout << BlackholeCollusionRegistry::GetNCaptured() << " flow captures by "
+              << BlackholeCollusionRegistry::GetNMembers() << " colluders" << std::endl;
+
+    // Dump the binary decision rings of the attackers
+    for (uint32_t i = 0; i < blackholeRoutings.size(); ++i) {
+        std::ostringstream fileName;
+        fileName << "blackhole-events-" << blackholeNodes[i] << ".bin";
+        std::ofstream ringFile(fileName.str(), std::ios::binary);
+        blackholeRoutings[i]->DumpEventRing(ringFile);
+    }
+
     // Serialize flow monitor results
     monitor->SerializeToXmlFile("flowmon-results.xml", true, true);
 